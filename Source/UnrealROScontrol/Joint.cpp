@@ -48,15 +48,6 @@ void UJoint::BeginPlay()
 		AJointManager *JointManager = *Itr;
 		JointManager->Subscribe(this);
 	}
-
-	UWorld* World = GetWorld();
-	if (World)
-	{
-		World->GetTimerManager().SetTimer(TimerHandle, this, &UJoint::CalcVelocity, 0.02f, true);
-	}
-
-	oldAngle = GetAngle();
-	oldPosition = GetAngle();
 }
 
 void UJoint::ExecuteCommand(double command)
@@ -75,9 +66,9 @@ void UJoint::ExecuteCommand(double command)
 	}
 }
 
-float UJoint::GetAngle()
+float UJoint::GetCurrentTwist() const
 {
-	return position;
+	return ConstraintInstance.GetCurrentTwist();
 }
 
 void UJoint::SetAngle(float value)
@@ -89,33 +80,6 @@ void UJoint::SetAngle(float value)
 }
 
 
-void UJoint::CalcVelocity()
-{
-
-	float angle = ConstraintInstance.GetCurrentTwist();
-	double time = FPlatformTime::Seconds();
-
-	float deltatime = time - oldTime;
-	
-	velocity = angle - oldAngle;
-
-	if (abs(velocity) > PI) 
-		velocity -= (signbit(velocity) ? -1 : 1) * 2 * PI;
-
-	position = oldPosition + velocity;
-
-	velocity /= deltatime;
-	
-	oldAngle = angle;
-	oldTime = time;
-	oldPosition = position;
-}
-
-float UJoint::GetAngularVelocity()
-{
-	return velocity;
-}
-
 void UJoint::SetAngularVelocity(float value)
 {
 	ConstraintInstance.SetOrientationDriveTwistAndSwing(false, false);
@@ -128,10 +92,53 @@ float UJoint::GetEffort()
 
 	ConstraintInstance.GetConstraintForce(linear, angular);
 	//UE_LOG(LogTemp, Error, TEXT("%s"), *angular.ToString());
-	return angular.X / 100000; // because UE uses cm instead of m
+	return angular.X / JOINT_EFFORT_SCALE; // because UE uses cm instead of m
+}
+
+void UJoint::DisableDrive()
+{
+	ConstraintInstance.SetOrientationDriveTwistAndSwing(false, false);
+	ConstraintInstance.SetAngularVelocityDriveTwistAndSwing(false, false);
+}
+
+void UJoint::ApplyEffort(float effort)
+{
+	FBodyInstance* Body1 = GetBodyInstance(EConstraintFrame::Frame1);
+	FBodyInstance* Body2 = GetBodyInstance(EConstraintFrame::Frame2);
+
+	// PhysX measures the twist of the first body relative to the second around the first body's primary axis
+	FVector axis;
+	if (Body1)
+	{
+		axis = Body1->GetUnrealWorldTransform().TransformVectorNoScale(ConstraintInstance.PriAxis1);
+	}
+	else if (Body2)
+	{
+		axis = Body2->GetUnrealWorldTransform().TransformVectorNoScale(ConstraintInstance.PriAxis2);
+	}
+	else
+	{
+		return;
+	}
+
+	// called for every substep, so the torque must not be spread over substeps again
+	const FVector torque = axis * (effort * JOINT_EFFORT_SCALE);
+	if (Body1)
+	{
+		Body1->AddTorqueInRadians(torque, false);
+	}
+	if (Body2)
+	{
+		Body2->AddTorqueInRadians(-torque, false);
+	}
 }
 
 UPrimitiveComponent* UJoint::GetComponentInternal(EConstraintFrame::Type Frame) const
+{
+	return GetFrameCache(Frame).Component.Get();
+}
+
+UPrimitiveComponent* UJoint::FindComponentInternal(EConstraintFrame::Type Frame) const
 {
 	UPrimitiveComponent* PrimComp = NULL;
 
@@ -235,6 +242,52 @@ int32 GetBoneIndexHelper(FName InBoneName, const USkeletalMeshComponent& SkelCom
 	return SkelComp.GetBoneIndex(BoneName);
 }
 
+const FJointFrameCache& UJoint::GetFrameCache(EConstraintFrame::Type Frame) const
+{
+	return FrameCache[Frame == EConstraintFrame::Frame1 ? 0 : 1];
+}
+
+void UJoint::ResolveFrames()
+{
+	check(IsInGameThread());
+
+	FrameCache[0].Component = FindComponentInternal(EConstraintFrame::Frame1);
+	FrameCache[0].BoneName = ConstraintInstance.ConstraintBone1;
+	FrameCache[1].Component = FindComponentInternal(EConstraintFrame::Frame2);
+	FrameCache[1].BoneName = ConstraintInstance.ConstraintBone2;
+
+	// bone lookups go through the skeleton by name, do them here instead of on every transform query
+	for (FJointFrameCache& Cache : FrameCache)
+	{
+		Cache.BoneIndex = INDEX_NONE;
+		Cache.BodyIndex = INDEX_NONE;
+		Cache.PhysicsAsset = nullptr;
+		if (const USkeletalMeshComponent* SkelComp = Cast<USkeletalMeshComponent>(Cache.Component.Get()))
+		{
+			Cache.BoneIndex = GetBoneIndexHelper(Cache.BoneName, *SkelComp, &Cache.BodyIndex);
+			Cache.PhysicsAsset = SkelComp->GetPhysicsAsset();
+		}
+	}
+}
+
+int32 UJoint::GetBoneIndexInternal(EConstraintFrame::Type Frame, FName InBoneName, const USkeletalMeshComponent& SkelComp, int32* BodyIndex) const
+{
+	const FJointFrameCache& Cache = GetFrameCache(Frame);
+	const UPhysicsAsset* PhysAsset = SkelComp.GetPhysicsAsset();
+	if (Cache.BoneIndex != INDEX_NONE && InBoneName == Cache.BoneName && &SkelComp == Cache.Component.Get()
+		&& PhysAsset && PhysAsset == Cache.PhysicsAsset.Get())
+	{
+		if (BodyIndex)
+		{
+			*BodyIndex = Cache.BodyIndex;
+		}
+		return Cache.BoneIndex;
+	}
+
+	// another bone, or the mesh changed since the frames were resolved
+	return GetBoneIndexHelper(InBoneName, SkelComp, BodyIndex);
+}
+
 FTransform UJoint::GetBodyTransformInternal(EConstraintFrame::Type Frame, FName InBoneName) const
 {
 	UPrimitiveComponent* PrimComp = GetComponentInternal(Frame);
@@ -249,7 +302,7 @@ FTransform UJoint::GetBodyTransformInternal(EConstraintFrame::Type Frame, FName
 	// Skeletal case
 	if (const USkeletalMeshComponent* SkelComp = Cast<USkeletalMeshComponent>(PrimComp))
 	{
-		const int32 BoneIndex = GetBoneIndexHelper(InBoneName, *SkelComp);
+		const int32 BoneIndex = GetBoneIndexInternal(Frame, InBoneName, *SkelComp);
 		if (BoneIndex != INDEX_NONE)
 		{
 			ResultTM = SkelComp->GetBoneTransform(BoneIndex);
@@ -278,7 +331,7 @@ FBox UJoint::GetBodyBoxInternal(EConstraintFrame::Type Frame, FName InBoneName)
 		if (const UPhysicsAsset* PhysicsAsset = SkelComp->GetPhysicsAsset())
 		{
 			int32 BodyIndex;
-			const int32 BoneIndex = GetBoneIndexHelper(InBoneName, *SkelComp, &BodyIndex);
+			const int32 BoneIndex = GetBoneIndexInternal(Frame, InBoneName, *SkelComp, &BodyIndex);
 			if (BoneIndex != INDEX_NONE && BodyIndex != INDEX_NONE)
 			{
 				const FTransform BoneTransform = SkelComp->GetBoneTransform(BoneIndex);
@@ -327,20 +380,15 @@ FBox UJoint::GetBodyBox(EConstraintFrame::Type Frame) const
 
 FBodyInstance* UJoint::GetBodyInstance(EConstraintFrame::Type Frame) const
 {
-	FBodyInstance* Instance = NULL;
-	UPrimitiveComponent* PrimComp = GetComponentInternal(Frame);
-	if (PrimComp != NULL)
+	const FJointFrameCache& Cache = GetFrameCache(Frame);
+	UPrimitiveComponent* PrimComp = Cache.Component.Get();
+	if (PrimComp == NULL)
 	{
-		if (Frame == EConstraintFrame::Frame1)
-		{
-			Instance = PrimComp->GetBodyInstance(ConstraintInstance.ConstraintBone1);
-		}
-		else
-		{
-			Instance = PrimComp->GetBodyInstance(ConstraintInstance.ConstraintBone2);
-		}
+		return NULL;
 	}
-	return Instance;
+
+	// the component knows its current bodies and welding, only the lookup of the component is cached
+	return PrimComp->GetBodyInstance(Cache.BoneName);
 }
 
 
@@ -396,6 +444,7 @@ void UJoint::SetConstrainedComponents(UPrimitiveComponent* Component1, FName Bon
 		ConstraintInstance.ConstraintBone2 = BoneName2;
 	}
 
+	ResolveFrames();
 	InitComponentConstraint();
 }
 
@@ -408,6 +457,8 @@ void UJoint::BreakConstraint()
 void UJoint::InitializeComponent()
 {
 	Super::InitializeComponent();
+	// every component of the actor exists by now, resolve here and not from the physics thread
+	ResolveFrames();
 	InitComponentConstraint();
 }
 
@@ -416,6 +467,9 @@ void UJoint::OnRegister()
 {
 	Super::OnRegister();
 
+	// the visualizer and frame updates in the editor need the frames before play initializes them
+	ResolveFrames();
+
 	if (SpriteComponent)
 	{
 		UpdateSpriteTexture();
@@ -459,8 +513,9 @@ void UJoint::PostLoad()
 		//We now multiply mass into the spring constant. To fix old data we use CalculateMass which is not perfect but close (within 0.1kg)
 		//We also use the primitive body instance directly for determining if simulated - this is potentially wrong for fixed bones in skeletal mesh, but it's much more likely right (in skeletal case we don't have access to bodies to check)
 
-		UPrimitiveComponent * Primitive1 = GetComponentInternal(EConstraintFrame::Frame1);
-		UPrimitiveComponent * Primitive2 = GetComponentInternal(EConstraintFrame::Frame2);
+		// the frame cache is only resolved once the component initializes, look the components up directly
+		UPrimitiveComponent * Primitive1 = FindComponentInternal(EConstraintFrame::Frame1);
+		UPrimitiveComponent * Primitive2 = FindComponentInternal(EConstraintFrame::Frame2);
 
 		int NumDynamic = 0;
 		float TotalMass = 0.f;
@@ -506,6 +561,8 @@ void UJoint::PostEditChangeChainProperty(FPropertyChangedChainEvent& PropertyCha
 
 void UJoint::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
 {
+	// actors, component names and bones are all edited here, also on undo
+	ResolveFrames();
 	Super::PostEditChangeProperty(PropertyChangedEvent);
 	UpdateConstraintFrames();
 	UpdateSpriteTexture();
@@ -6,8 +6,33 @@
 #include "Components/SceneComponent.h"
 #include "PhysicsEngine/ConstraintInstance.h"
 #include "EngineUtils.h"
+#include "JointFilter.h"
+#include "JointController.h"
 #include "Joint.generated.h"
 
+class UPhysicsAsset;
+class USkeletalMeshComponent;
+
+/** Unreal constraint torque per N m of effort */
+#define JOINT_EFFORT_SCALE 100000.f
+
+
+/**
+ * What one constraint frame resolves to. Looked up on the game thread when the component is
+ * registered or initialized and whenever the actors, component names, bones or override components
+ * change. Bodies are not cached, the component hands out the current one for the bone.
+ */
+struct FJointFrameCache
+{
+	TWeakObjectPtr<UPrimitiveComponent> Component;
+	FName BoneName;
+	/** Bone and physics body of BoneName on a skeletal Component, INDEX_NONE otherwise */
+	int32 BoneIndex = INDEX_NONE;
+	int32 BodyIndex = INDEX_NONE;
+	/** The indices above hold as long as the skeletal component still uses this physics asset */
+	TWeakObjectPtr<const UPhysicsAsset> PhysicsAsset;
+};
+
 
 UENUM(BlueprintType)		//"BlueprintType" is essential to include
 enum class EJointTypeEnum : uint8
@@ -61,15 +86,8 @@ class UNREALROSCONTROL_API UJoint : public USceneComponent
 	UPROPERTY(BlueprintAssignable)
 		FConstraintBrokenSignature OnConstraintBroken;
 
-	FTimerHandle TimerHandle;
-	double oldTime = 0;
-	float oldAngle = 0;
-	float velocity = 0;
-	float oldPosition = 0;
-	float position = 0;
-
-	UFUNCTION()
-		void CalcVelocity();
+	/** Resolved frames 1 and 2, written by ResolveFrames only, so the physics thread just reads them */
+	FJointFrameCache FrameCache[2];
 
 public:	
 	UPROPERTY(EditAnywhere, Category = Joint)
@@ -78,17 +96,32 @@ public:
 	UPROPERTY(EditAnywhere, Category = Joint)
 	EJointTypeEnum JointType;
 
+	/** Use the filter settings below instead of the ones of the joint manager */
+	UPROPERTY(EditAnywhere, Category = Joint)
+	bool bOverrideFilter;
+
+	UPROPERTY(EditAnywhere, Category = Joint, meta = (EditCondition = "bOverrideFilter"))
+	FJointFilterSettings Filter;
+
+	/** PID control runs in physics step sampling mode only, with timer sampling the angular drive stays in charge */
+	UPROPERTY(EditAnywhere, Category = Joint)
+	FJointControllerSettings Controller;
+
 	// Sets default values for this component's properties
 	UJoint();
 
 	virtual void BeginPlay() override;
 
 	void ExecuteCommand(double command);
-	float GetAngle();
+	/** Raw twist of the constraint in (-PI, PI], unwrapping and differentiation happen in AJointManager */
+	float GetCurrentTwist() const;
 	void SetAngle(float value);
-	float GetAngularVelocity();
 	void SetAngularVelocity(float value);
 	float GetEffort();
+	/** Turns the angular drive off, the joint then only moves under ApplyEffort */
+	void DisableDrive();
+	/** Twist torque in N m between the constrained bodies for the next physics step */
+	void ApplyEffort(float effort);
 
 
 	/** All constraint settings */
@@ -163,8 +196,17 @@ protected:
 	FTransform GetBodyTransformInternal(EConstraintFrame::Type Frame, FName InBoneName) const;
 	/** Internal util to get body box from actor/component name/bone name information */
 	FBox GetBodyBoxInternal(EConstraintFrame::Type Frame, FName InBoneName) const;
-	/** Internal util to get component from actor/component name */
+	/** Internal util to get component from actor/component name, resolved once through the frame cache */
 	UPrimitiveComponent* GetComponentInternal(EConstraintFrame::Type Frame) const;
+	/** Searches the actor's components, only called when the frame cache is resolved */
+	UPrimitiveComponent* FindComponentInternal(EConstraintFrame::Type Frame) const;
+
+	/** Returns the frame as last resolved */
+	const FJointFrameCache& GetFrameCache(EConstraintFrame::Type Frame) const;
+	/** Bone index of InBoneName on the frame's skeletal component, from the frame cache while it is still valid */
+	int32 GetBoneIndexInternal(EConstraintFrame::Type Frame, FName InBoneName, const USkeletalMeshComponent& SkelComp, int32* BodyIndex = nullptr) const;
+	/** Looks both frames up again, call on the game thread whenever what they resolve from changes */
+	void ResolveFrames();
 
 	/** Routes the FConstraint callback to the dynamic delegate */
 	void OnConstraintBrokenHandler(FConstraintInstance* BrokenConstraint);
@@ -0,0 +1,137 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Plain C++ on purpose, Tools/ByteSwapBench builds this header without the engine.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define JOINT_BYTESWAP_AVX2 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JOINT_BYTESWAP_SSE2 1
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define JOINT_BYTESWAP_BIG_ENDIAN 1
+#endif
+
+
+/**
+ * Batch conversion of contiguous value blocks between host and network byte order. Used for the
+ * fixed layout blocks of ID frames, so encoding is bound by memory bandwidth instead of one
+ * shift-and-mask macro per value. Swapping is its own inverse, the same kernels encode and decode.
+ */
+namespace JointByteSwap
+{
+	inline uint64_t Swap64(uint64_t value)
+	{
+		value = ((value & 0x00FF00FF00FF00FFull) << 8) | ((value >> 8) & 0x00FF00FF00FF00FFull);
+		value = ((value & 0x0000FFFF0000FFFFull) << 16) | ((value >> 16) & 0x0000FFFF0000FFFFull);
+		return (value << 32) | (value >> 32);
+	}
+
+	inline uint16_t Swap16(uint16_t value)
+	{
+		return (uint16_t)((value << 8) | (value >> 8));
+	}
+
+	/** Reference implementation, also handles the tail of the vector kernels */
+	inline void Swap64Scalar(void *dst, const void *src, size_t count)
+	{
+		const uint8_t *in = (const uint8_t *)src;
+		uint8_t *out = (uint8_t *)dst;
+		for (size_t i = 0; i < count; i++)
+		{
+			uint64_t value;
+			memcpy(&value, in + i * 8, 8);
+			value = Swap64(value);
+			memcpy(out + i * 8, &value, 8);
+		}
+	}
+
+	inline void Swap16Scalar(void *dst, const void *src, size_t count)
+	{
+		const uint8_t *in = (const uint8_t *)src;
+		uint8_t *out = (uint8_t *)dst;
+		for (size_t i = 0; i < count; i++)
+		{
+			uint16_t value;
+			memcpy(&value, in + i * 2, 2);
+			value = Swap16(value);
+			memcpy(out + i * 2, &value, 2);
+		}
+	}
+
+#if JOINT_BYTESWAP_SSE2
+	/** Swaps the bytes of both 64 bit lanes with SSE2 only: bytes within words, then the word order */
+	inline __m128i Swap64x2(__m128i value)
+	{
+		value = _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+		value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(0, 1, 2, 3));
+		return _mm_shufflehi_epi16(value, _MM_SHUFFLE(0, 1, 2, 3));
+	}
+#endif
+
+	/** Byte swaps count 64 bit values, dst and src may be unaligned but must not overlap partially */
+	inline void Swap64Block(void *dst, const void *src, size_t count)
+	{
+#if JOINT_BYTESWAP_BIG_ENDIAN
+		memmove(dst, src, count * 8);
+#else
+		const uint8_t *in = (const uint8_t *)src;
+		uint8_t *out = (uint8_t *)dst;
+		size_t i = 0;
+
+#if JOINT_BYTESWAP_AVX2
+		const __m256i mask = _mm256_setr_epi8(
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m256i value = _mm256_loadu_si256((const __m256i *)(in + i * 8));
+			_mm256_storeu_si256((__m256i *)(out + i * 8), _mm256_shuffle_epi8(value, mask));
+		}
+#endif
+
+#if JOINT_BYTESWAP_SSE2
+		for (; i + 2 <= count; i += 2)
+		{
+			__m128i value = _mm_loadu_si128((const __m128i *)(in + i * 8));
+			_mm_storeu_si128((__m128i *)(out + i * 8), Swap64x2(value));
+		}
+#endif
+
+		Swap64Scalar(out + i * 8, in + i * 8, count - i);
+#endif
+	}
+
+	/** Byte swaps count 16 bit values */
+	inline void Swap16Block(void *dst, const void *src, size_t count)
+	{
+#if JOINT_BYTESWAP_BIG_ENDIAN
+		memmove(dst, src, count * 2);
+#else
+		const uint8_t *in = (const uint8_t *)src;
+		uint8_t *out = (uint8_t *)dst;
+		size_t i = 0;
+
+#if JOINT_BYTESWAP_SSE2
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i value = _mm_loadu_si128((const __m128i *)(in + i * 2));
+			value = _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+			_mm_storeu_si128((__m128i *)(out + i * 2), value);
+		}
+#endif
+
+		Swap16Scalar(out + i * 2, in + i * 2, count - i);
+#endif
+	}
+}
@@ -0,0 +1,280 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointCodec.h"
+
+
+namespace JointCodec
+{
+	EFrameStatus PeekFrame(const uint8_t *data, size_t size, uint32_t &length)
+	{
+		length = 0;
+		if (size < 4) return EFrameStatus::Incomplete;
+
+		memcpy(&length, data, 4);
+		length = ToNetwork32(length);
+
+		if (length < JOINT_FRAME_HEADER_SIZE - 4 || length > JOINT_FRAME_MAX_SIZE) return EFrameStatus::Invalid;
+		return size - 4 < length ? EFrameStatus::Incomplete : EFrameStatus::Complete;
+	}
+
+	static bool WriteHeader(FJointFrameWriter &writer, size_t frameSize, EJointFrameType type, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo)
+	{
+		if (!writer.Reserve(JOINT_FRAME_HEADER_SIZE)) return false;
+		writer.Pointer = WriteFrameHeader(writer.Pointer, (uint32_t)frameSize, type, sequence, timestamp, echo);
+		return true;
+	}
+
+	/** Label entries with a fixed number of doubles after each */
+	static bool WriteLabelled(FJointFrameWriter &writer, const FJointLabelEntries &labels, const double *values, size_t valuesPerJoint, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			const uint8_t *entry = labels.Data + labels.Offsets[i];
+			const size_t entrySize = labels.Sizes[i];
+			const double *jointValues = values + i * valuesPerJoint;
+
+			if (writer.Remaining() >= entrySize + valuesPerJoint * 8)
+			{
+				// common case, the whole joint fits the buffer
+				memcpy(writer.Pointer, entry, entrySize);
+				writer.Pointer += entrySize;
+				for (size_t v = 0; v < valuesPerJoint; v++)
+				{
+					writer.Pointer = WriteDouble(writer.Pointer, jointValues[v]);
+				}
+				continue;
+			}
+
+			if (!writer.WriteBytes(entry, entrySize) || !writer.WriteDoubles(jointValues, valuesPerJoint)) return false;
+		}
+		return true;
+	}
+
+	static bool WriteIdState(FJointFrameWriter &writer, EJointFrameType type, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const uint16_t *networkIds, const double *values, size_t count, const FJointValueFormat &format)
+	{
+		return WriteHeader(writer, IdStateFrameSize(count, format.Encoding), type, sequence, timestamp, echo)
+			&& writer.WriteShort((uint16_t)count)
+			&& writer.WriteBytes(networkIds, count * 2)
+			&& writer.WriteValues(values, count * 3, format.Encoding, format.Scales, 3);
+	}
+
+	static bool WriteLabelState(FJointFrameWriter &writer, EJointFrameType type, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointLabelEntries &labels, const double *values, size_t count)
+	{
+		return WriteHeader(writer, LabelStateFrameSize(labels, count), type, sequence, timestamp, echo)
+			&& writer.WriteShort((uint16_t)count)
+			&& WriteLabelled(writer, labels, values, 3, count);
+	}
+
+	bool EncodeIdState(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const uint16_t *networkIds, const double *values, size_t count, const FJointValueFormat &format)
+	{
+		return WriteIdState(writer, EJointFrameType::State, sequence, timestamp, echo, networkIds, values, count, format);
+	}
+
+	bool EncodeLabelState(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointLabelEntries &labels, const double *values, size_t count)
+	{
+		return WriteLabelState(writer, EJointFrameType::State, sequence, timestamp, echo, labels, values, count);
+	}
+
+	bool EncodeIdStateDelta(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const uint16_t *networkIds, const double *values, size_t count, const FJointValueFormat &format)
+	{
+		return WriteIdState(writer, EJointFrameType::StateDelta, sequence, timestamp, echo, networkIds, values, count, format);
+	}
+
+	bool EncodeLabelStateDelta(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointLabelEntries &labels, const double *values, size_t count)
+	{
+		return WriteLabelState(writer, EJointFrameType::StateDelta, sequence, timestamp, echo, labels, values, count);
+	}
+
+	bool EncodeHandshake(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, uint16_t version,
+		const uint16_t *ids, const FJointLabelEntries &labels, size_t count, const FJointValueFormat &format)
+	{
+		if (!WriteHeader(writer, HandshakeFrameSize(labels, count), EJointFrameType::Handshake, sequence, timestamp, FJointFrameEcho())) return false;
+		if (!writer.WriteShort(version) || !writer.WriteShort((uint16_t)count)) return false;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!writer.WriteShort(ids[i]) || !writer.WriteBytes(labels.Data + labels.Offsets[i], labels.Sizes[i])) return false;
+		}
+
+		// after the entries, so bridges that only know doubles can ignore it
+		if (!writer.Reserve(JOINT_HANDSHAKE_FORMAT_SIZE)) return false;
+		*writer.Pointer++ = (uint8_t)format.Encoding;
+		for (size_t i = 0; i < JOINT_SCALE_COUNT; i++)
+		{
+			writer.Pointer = WriteFloat(writer.Pointer, format.Scales[i]);
+		}
+		return true;
+	}
+
+	bool EncodeIdCommand(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const uint16_t *ids, const double *values, size_t count, const FJointValueFormat &format)
+	{
+		if (!WriteHeader(writer, IdCommandFrameSize(count, format.Encoding), EJointFrameType::Command, sequence, timestamp, echo)) return false;
+		if (!writer.WriteShort((uint16_t)count)) return false;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!writer.WriteShort(ids[i])) return false;
+		}
+		return writer.WriteValues(values, count, format.Encoding, &format.Scales[JOINT_SCALE_COMMAND], 1);
+	}
+
+	bool EncodeTrajectory(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointTrajectorySegment *segments, size_t count)
+	{
+		if (!WriteHeader(writer, TrajectoryFrameSize(count), EJointFrameType::Trajectory, sequence, timestamp, echo)) return false;
+		if (!writer.WriteShort((uint16_t)count)) return false;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const FJointTrajectorySegment &segment = segments[i];
+			if (!writer.Reserve(2 + 8 + 4)) return false;
+			writer.Pointer = WriteShort(writer.Pointer, segment.Id);
+			writer.Pointer = WriteLong(writer.Pointer, segment.Start);
+			writer.Pointer = WriteInt(writer.Pointer, segment.Duration);
+			if (!writer.WriteDoubles(segment.Coefficients, JOINT_SEGMENT_COEFFICIENTS)) return false;
+		}
+		return true;
+	}
+
+	bool EncodeLabelCommand(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointLabelEntries &labels, const double *values, size_t count)
+	{
+		return WriteHeader(writer, LabelCommandFrameSize(labels, count), EJointFrameType::Command, sequence, timestamp, echo)
+			&& writer.WriteShort((uint16_t)count)
+			&& WriteLabelled(writer, labels, values, 1, count);
+	}
+}
+
+
+bool FJointFrameWriter::WriteBytes(const void *data, size_t size)
+{
+	const uint8_t *source = (const uint8_t *)data;
+	while (size > 0)
+	{
+		if (Remaining() == 0 && !Reserve(1)) return false;
+
+		size_t n = size < Remaining() ? size : Remaining();
+		memcpy(Pointer, source, n);
+		Pointer += n;
+		source += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool FJointFrameWriter::WriteDoubles(const double *values, size_t count)
+{
+	while (count > 0)
+	{
+		if (!Reserve(8)) return false;
+
+		size_t n = Remaining() / 8;
+		if (n > count) n = count;
+		JointByteSwap::Swap64Block(Pointer, values, n);
+		Pointer += n * 8;
+		values += n;
+		count -= n;
+	}
+	return true;
+}
+
+bool FJointFrameWriter::WriteValues(const double *values, size_t count, EJointValueEncoding encoding, const float *scales, size_t scaleCount)
+{
+	if (encoding == EJointValueEncoding::Double) return WriteDoubles(values, count);
+
+	const size_t valueSize = JointCodec::ValueSize(encoding);
+	// inverse scales repeated over a block, so the quantize loop has no channel counter to carry
+	const size_t blockSize = 240;
+	double inverse[blockSize + JOINT_SCALE_COUNT];
+	if (encoding == EJointValueEncoding::Fixed16)
+	{
+		const size_t patternSize = (count < blockSize ? count : blockSize) + scaleCount;
+		for (size_t c = 0; c < patternSize; c++)
+		{
+			inverse[c] = c < scaleCount ? 1.0 / scales[c] : inverse[c - scaleCount];
+		}
+	}
+
+	size_t index = 0;
+	while (index < count)
+	{
+		if (!Reserve(valueSize)) return false;
+
+		size_t end = index + Remaining() / valueSize;
+		if (end > count) end = count;
+
+		// a local cursor, stores through the byte pointer would otherwise reload the member every value
+		uint8_t *pointer = Pointer;
+		if (encoding == EJointValueEncoding::Float)
+		{
+			for (; index < end; index++)
+			{
+				pointer = JointCodec::WriteFloat(pointer, (float)values[index]);
+			}
+		}
+		else
+		{
+			// quantized in host order a block at a time, then swapped by the 16 bit block kernel
+			int16_t block[blockSize];
+			while (index < end)
+			{
+				const size_t n = end - index < blockSize ? end - index : blockSize;
+				const double *scale = inverse + index % scaleCount;
+				for (size_t i = 0; i < n; i++)
+				{
+					// saturate, then round half up by truncating a value that is always positive
+					double steps = values[index + i] * scale[i];
+					steps = steps < 32767.0 ? steps : 32767.0;
+					steps = steps > -32767.0 ? steps : -32767.0;
+					block[i] = (int16_t)((int32_t)(steps + 32768.5) - 32768);
+				}
+				JointByteSwap::Swap16Block(pointer, block, n);
+				pointer += n * 2;
+				index += n;
+			}
+		}
+		Pointer = pointer;
+	}
+	return true;
+}
+
+bool FJointFrameReader::ReadValues(double *values, size_t count, EJointValueEncoding encoding, const float *scales, size_t scaleCount)
+{
+	if (encoding == EJointValueEncoding::Double) return ReadDoubles(values, count);
+	if ((size_t)(End - Pointer) < count * JointCodec::ValueSize(encoding)) return false;
+
+	const uint8_t *pointer = Pointer;
+	if (encoding == EJointValueEncoding::Float)
+	{
+		for (size_t i = 0; i < count; i++, pointer += 4)
+		{
+			uint32_t bits;
+			memcpy(&bits, pointer, 4);
+			bits = JointCodec::ToNetwork32(bits);
+			float value;
+			memcpy(&value, &bits, 4);
+			values[i] = value;
+		}
+	}
+	else
+	{
+		size_t channel = 0;
+		for (size_t i = 0; i < count; i++, pointer += 2)
+		{
+			uint16_t bits;
+			memcpy(&bits, pointer, 2);
+			values[i] = (int16_t)JointCodec::ToNetwork16(bits) * (double)scales[channel];
+			channel = channel + 1 == scaleCount ? 0 : channel + 1;
+		}
+	}
+	Pointer = pointer;
+	return true;
+}
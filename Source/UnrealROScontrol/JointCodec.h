@@ -0,0 +1,531 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Plain C++ on purpose, Tools/CodecBench builds the codec without the engine. Sockets, threads and
+// joints stay in the engine side classes, this only turns values into frames and back.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "JointByteSwap.h"
+
+
+/** Joints are identified by their label string in every frame. */
+#define JOINT_PROTOCOL_LABELS 1
+/** Labels are exchanged once in the handshake, frames carry joint IDs. */
+#define JOINT_PROTOCOL_IDS 2
+
+/**
+ * Protocol v2 state and command frames use a fixed block layout: uint16 joint count, all uint16 IDs,
+ * then all values as doubles (angle, velocity, effort per joint for state, one per joint for commands).
+ * Both blocks are byte swapped in one go by JointByteSwap.
+ *
+ * State delta frames have the layout of state frames of the negotiated version but only list the joints
+ * that moved, joints left out keep the values the bridge has last received for them. Delta frames are
+ * only sent when enabled on the AJointManager, between full state frames sent as keyframes.
+ */
+
+/**
+ * Protocol v2 trajectory frames: uint16 segment count, then per segment uint16 joint ID, uint64 start
+ * on the bridge clock in microseconds, uint32 duration in microseconds and JOINT_SEGMENT_COEFFICIENTS
+ * doubles. The coefficients describe the joint's command value as a polynomial in the seconds since
+ * the segment start, lowest order first, cubic segments leave the last two at zero. They stay doubles
+ * whatever value encoding was negotiated, higher order terms do not survive quantization.
+ */
+#define JOINT_SEGMENT_COEFFICIENTS 6
+#define JOINT_SEGMENT_SIZE (2 + 8 + 4 + JOINT_SEGMENT_COEFFICIENTS * 8)
+
+/**
+ * Protocol v2 values are doubles unless the handshake negotiates a compact encoding. The handshake
+ * ends with the requested EJointValueEncoding as uint8 and JOINT_SCALE_COUNT float scales, the
+ * bridge appends the encoding it will use to its reply. A reply without it means doubles. The joint
+ * values are floats in the engine, so float and fixed point encodings lose no real precision.
+ */
+#define JOINT_HANDSHAKE_FORMAT_SIZE (1 + JOINT_SCALE_COUNT * 4)
+
+/** Fixed point scale channels of FJointValueFormat, state values cycle through the first three */
+#define JOINT_SCALE_ANGLE 0
+#define JOINT_SCALE_VELOCITY 1
+#define JOINT_SCALE_EFFORT 2
+#define JOINT_SCALE_COMMAND 3
+#define JOINT_SCALE_COUNT 4
+
+/**
+ * uint32 length of everything after the length field, uint8 frame type, uint32 sequence number,
+ * uint64 sender timestamp, then the uint32 sequence number and uint64 timestamp of the newest frame
+ * received from the other side (0 until there is one). Every sender numbers its frames, so datagram
+ * receivers can drop frames that arrive late or twice. Timestamps are microseconds since the Unix
+ * epoch, the echo lets each side measure the round trip with its own clock alone.
+ */
+#define JOINT_FRAME_HEADER_SIZE 29
+/** Frames announcing more than this are treated as a corrupt stream */
+#define JOINT_FRAME_MAX_SIZE (16 * 1024 * 1024)
+
+
+enum class EJointFrameType : uint8_t
+{
+	Handshake = 1,
+	State = 2,
+	Command = 3,
+	StateDelta = 4,
+	Trajectory = 5,
+};
+
+enum class EJointValueEncoding : uint8_t
+{
+	/** Big endian IEEE 754 double, the only encoding of protocol v1 */
+	Double = 0,
+	/** Big endian IEEE 754 float */
+	Float = 1,
+	/** Big endian int16 counting steps of the channel's scale, values out of range saturate */
+	Fixed16 = 2,
+};
+
+/** Value encoding of protocol v2 state and command frames */
+struct FJointValueFormat
+{
+	EJointValueEncoding Encoding = EJointValueEncoding::Double;
+	/** Value of one fixed point step per channel: 0.1 mrad, 1 mrad/s, 0.01 effort units, 0.1 mrad */
+	float Scales[JOINT_SCALE_COUNT] = { 0.0001f, 0.001f, 0.01f, 0.0001f };
+};
+
+/** Identifies the newest frame received from the other side, echoed in the header of every frame sent */
+struct FJointFrameEcho
+{
+	uint32_t Sequence = 0;
+	uint64_t Timestamp = 0;
+};
+
+/** Header fields after the length, see JOINT_FRAME_HEADER_SIZE */
+struct FJointFrameHeader
+{
+	uint8_t Type;
+	uint32_t Sequence;
+	uint64_t Timestamp;
+	FJointFrameEcho Echo;
+};
+
+/** One polynomial piece of a joint trajectory, see JOINT_SEGMENT_SIZE */
+struct FJointTrajectorySegment
+{
+	uint16_t Id;
+	uint64_t Start;
+	uint32_t Duration;
+	double Coefficients[JOINT_SEGMENT_COEFFICIENTS];
+};
+
+/**
+ * Labels of all joints in frame order, each already encoded as on the wire: uint16 length including
+ * the terminating null, then the ANSI text. Encoded once per joint set with JointCodec::WriteLabel.
+ */
+struct FJointLabelEntries
+{
+	const uint8_t *Data;
+	const int32_t *Offsets;
+	const int32_t *Sizes;
+	/** Sum of all entry sizes */
+	size_t TotalSize;
+};
+
+
+namespace JointCodec
+{
+	inline uint16_t ToNetwork16(uint16_t value)
+	{
+#if JOINT_BYTESWAP_BIG_ENDIAN
+		return value;
+#else
+		return JointByteSwap::Swap16(value);
+#endif
+	}
+
+	inline uint32_t ToNetwork32(uint32_t value)
+	{
+#if JOINT_BYTESWAP_BIG_ENDIAN
+		return value;
+#else
+		return (uint32_t)(JointByteSwap::Swap64(value) >> 32);
+#endif
+	}
+
+	inline uint64_t ToNetwork64(uint64_t value)
+	{
+#if JOINT_BYTESWAP_BIG_ENDIAN
+		return value;
+#else
+		return JointByteSwap::Swap64(value);
+#endif
+	}
+
+	inline uint8_t *WriteShort(uint8_t *pointer, uint16_t value)
+	{
+		value = ToNetwork16(value);
+		memcpy(pointer, &value, 2);
+		return pointer + 2;
+	}
+
+	inline uint8_t *WriteInt(uint8_t *pointer, uint32_t value)
+	{
+		value = ToNetwork32(value);
+		memcpy(pointer, &value, 4);
+		return pointer + 4;
+	}
+
+	inline uint8_t *WriteLong(uint8_t *pointer, uint64_t value)
+	{
+		value = ToNetwork64(value);
+		memcpy(pointer, &value, 8);
+		return pointer + 8;
+	}
+
+	inline uint8_t *WriteFloat(uint8_t *pointer, float value)
+	{
+		uint32_t temp;
+		memcpy(&temp, &value, 4);
+		return WriteInt(pointer, temp);
+	}
+
+	inline uint8_t *WriteDouble(uint8_t *pointer, double value)
+	{
+		uint64_t temp;
+		memcpy(&temp, &value, 8);
+		return WriteLong(pointer, temp);
+	}
+
+	/** Writes the header of a frame whose total size, header included, is known up front */
+	inline uint8_t *WriteFrameHeader(uint8_t *frame, uint32_t frameSize, EJointFrameType type, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo)
+	{
+		uint8_t *pointer = WriteInt(frame, frameSize - 4);
+		*pointer++ = (uint8_t)type;
+		pointer = WriteInt(pointer, sequence);
+		pointer = WriteLong(pointer, timestamp);
+		pointer = WriteInt(pointer, echo.Sequence);
+		return WriteLong(pointer, echo.Timestamp);
+	}
+
+	/** Bytes of a label entry for text of the given length, without the terminating null */
+	inline size_t LabelEntrySize(size_t textLength)
+	{
+		return 2 + textLength + 1;
+	}
+
+	/** Writes one label entry, see FJointLabelEntries */
+	inline uint8_t *WriteLabel(uint8_t *pointer, const char *text, size_t textLength)
+	{
+		pointer = WriteShort(pointer, (uint16_t)(textLength + 1));
+		memcpy(pointer, text, textLength);
+		pointer[textLength] = 0;
+		return pointer + textLength + 1;
+	}
+
+	inline size_t ValueSize(EJointValueEncoding encoding)
+	{
+		return encoding == EJointValueEncoding::Fixed16 ? 2 : encoding == EJointValueEncoding::Float ? 4 : 8;
+	}
+
+	inline bool IsValidEncoding(uint8_t encoding)
+	{
+		return encoding <= (uint8_t)EJointValueEncoding::Fixed16;
+	}
+
+	inline size_t IdStateFrameSize(size_t count, EJointValueEncoding encoding = EJointValueEncoding::Double)
+	{
+		return JOINT_FRAME_HEADER_SIZE + 2 + count * (2 + 3 * ValueSize(encoding));
+	}
+
+	inline size_t LabelStateFrameSize(const FJointLabelEntries &labels, size_t count)
+	{
+		return JOINT_FRAME_HEADER_SIZE + 2 + labels.TotalSize + count * 24;
+	}
+
+	inline size_t IdCommandFrameSize(size_t count, EJointValueEncoding encoding = EJointValueEncoding::Double)
+	{
+		return JOINT_FRAME_HEADER_SIZE + 2 + count * (2 + ValueSize(encoding));
+	}
+
+	inline size_t LabelCommandFrameSize(const FJointLabelEntries &labels, size_t count)
+	{
+		return JOINT_FRAME_HEADER_SIZE + 2 + labels.TotalSize + count * 8;
+	}
+
+	inline size_t TrajectoryFrameSize(size_t count)
+	{
+		return JOINT_FRAME_HEADER_SIZE + 2 + count * JOINT_SEGMENT_SIZE;
+	}
+
+	/** Value of a segment polynomial t seconds after its start */
+	inline double EvaluateSegment(const double *coefficients, double t)
+	{
+		double value = coefficients[JOINT_SEGMENT_COEFFICIENTS - 1];
+		for (int i = JOINT_SEGMENT_COEFFICIENTS - 2; i >= 0; i--)
+		{
+			value = value * t + coefficients[i];
+		}
+		return value;
+	}
+
+	/** Value, rate and acceleration of a segment polynomial t seconds after its start */
+	inline void EvaluateSegment(const double *coefficients, double t, double &value, double &rate, double &acceleration)
+	{
+		// Horner for the polynomial and its first two derivatives, the last one comes out halved
+		value = coefficients[JOINT_SEGMENT_COEFFICIENTS - 1];
+		rate = 0;
+		double halfAcceleration = 0;
+		for (int i = JOINT_SEGMENT_COEFFICIENTS - 2; i >= 0; i--)
+		{
+			halfAcceleration = halfAcceleration * t + rate;
+			rate = rate * t + value;
+			value = value * t + coefficients[i];
+		}
+		acceleration = 2 * halfAcceleration;
+	}
+
+	/** Cubic Hermite segment from value and rate at both ends over duration seconds */
+	inline void MakeCubicSegment(double *coefficients, double p0, double v0, double p1, double v1, double duration)
+	{
+		const double t = duration;
+		coefficients[0] = p0;
+		coefficients[1] = v0;
+		coefficients[2] = (3 * (p1 - p0) / t - 2 * v0 - v1) / t;
+		coefficients[3] = (2 * (p0 - p1) / t + v0 + v1) / (t * t);
+		coefficients[4] = 0;
+		coefficients[5] = 0;
+	}
+
+	/** Quintic segment from value, rate and acceleration at both ends, continuous up to the acceleration */
+	inline void MakeQuinticSegment(double *coefficients, double p0, double v0, double a0, double p1, double v1, double a1, double duration)
+	{
+		const double t = duration;
+		const double t2 = t * t;
+		coefficients[0] = p0;
+		coefficients[1] = v0;
+		coefficients[2] = a0 / 2;
+		coefficients[3] = (20 * (p1 - p0) - (8 * v1 + 12 * v0) * t - (3 * a0 - a1) * t2) / (2 * t2 * t);
+		coefficients[4] = (30 * (p0 - p1) + (14 * v1 + 16 * v0) * t + (3 * a0 - 2 * a1) * t2) / (2 * t2 * t2);
+		coefficients[5] = (12 * (p1 - p0) - 6 * (v1 + v0) * t - (a0 - a1) * t2) / (2 * t2 * t2 * t);
+	}
+
+	inline size_t HandshakeFrameSize(const FJointLabelEntries &labels, size_t count)
+	{
+		return JOINT_FRAME_HEADER_SIZE + 4 + count * 2 + labels.TotalSize + JOINT_HANDSHAKE_FORMAT_SIZE;
+	}
+
+	enum class EFrameStatus
+	{
+		Complete,
+		Incomplete,
+		Invalid,
+	};
+
+	/**
+	 * Looks at the start of received stream data. Once the length field is in, length is set to the
+	 * size of the frame after the length field, also for incomplete frames so the buffer can grow.
+	 */
+	EFrameStatus PeekFrame(const uint8_t *data, size_t size, uint32_t &length);
+}
+
+
+/**
+ * Encodes into a fixed buffer. Stream senders pass a flush function and get frames larger than the
+ * buffer handed over in pieces. Without one, writing past the end of the buffer fails.
+ */
+struct FJointFrameWriter
+{
+	typedef bool (*FFlushFunction)(void *context, const uint8_t *data, size_t size);
+
+	uint8_t *Start;
+	uint8_t *Pointer;
+	uint8_t *End;
+	FFlushFunction Flush;
+	void *Context;
+
+	FJointFrameWriter(uint8_t *buffer, size_t size, FFlushFunction flush = nullptr, void *context = nullptr)
+		: Start(buffer), Pointer(buffer), End(buffer + size), Flush(flush), Context(context)
+	{
+	}
+
+	size_t Size() const { return Pointer - Start; }
+	size_t Remaining() const { return End - Pointer; }
+
+	/** Makes room for size contiguous bytes, flushing what is encoded so far if necessary */
+	bool Reserve(size_t size)
+	{
+		if (Remaining() >= size) return true;
+		if (!Flush || !FlushPending()) return false;
+		return Remaining() >= size;
+	}
+
+	bool FlushPending()
+	{
+		bool ok = Pointer == Start || Flush(Context, Start, Size());
+		Pointer = Start;
+		return ok;
+	}
+
+	/** Hands the rest of the frame to the flush function, if there is one */
+	bool Finish()
+	{
+		return Flush ? FlushPending() : true;
+	}
+
+	bool WriteShort(uint16_t value)
+	{
+		if (!Reserve(2)) return false;
+		Pointer = JointCodec::WriteShort(Pointer, value);
+		return true;
+	}
+
+	bool WriteBytes(const void *data, size_t size);
+	/** Writes doubles in network order, the block byte swap runs on as many as fit at once */
+	bool WriteDoubles(const double *values, size_t count);
+	/** Writes values in the given encoding, value i uses scales[i % scaleCount] for fixed point */
+	bool WriteValues(const double *values, size_t count, EJointValueEncoding encoding, const float *scales, size_t scaleCount);
+};
+
+
+/** Bounds checked reader over a frame that has been received completely */
+struct FJointFrameReader
+{
+	const uint8_t *Pointer;
+	const uint8_t *End;
+
+	FJointFrameReader(const uint8_t *frame, size_t length)
+		: Pointer(frame), End(frame + length)
+	{
+	}
+
+	bool ReadByte(uint8_t &value)
+	{
+		if (End - Pointer < 1) return false;
+		value = *Pointer++;
+		return true;
+	}
+
+	bool ReadShort(uint16_t &value)
+	{
+		if (End - Pointer < 2) return false;
+		memcpy(&value, Pointer, 2);
+		value = JointCodec::ToNetwork16(value);
+		Pointer += 2;
+		return true;
+	}
+
+	bool ReadInt(uint32_t &value)
+	{
+		if (End - Pointer < 4) return false;
+		memcpy(&value, Pointer, 4);
+		value = JointCodec::ToNetwork32(value);
+		Pointer += 4;
+		return true;
+	}
+
+	bool ReadLong(uint64_t &value)
+	{
+		if (End - Pointer < 8) return false;
+		memcpy(&value, Pointer, 8);
+		value = JointCodec::ToNetwork64(value);
+		Pointer += 8;
+		return true;
+	}
+
+	bool ReadFloat(float &value)
+	{
+		uint32_t temp;
+		if (!ReadInt(temp)) return false;
+		memcpy(&value, &temp, 4);
+		return true;
+	}
+
+	bool ReadDouble(double &value)
+	{
+		uint64_t temp;
+		if (!ReadLong(temp)) return false;
+		memcpy(&value, &temp, 8);
+		return true;
+	}
+
+	/** Reads a block of uint16 values in host order */
+	bool ReadShorts(uint16_t *values, size_t count)
+	{
+		if ((size_t)(End - Pointer) < count * 2) return false;
+		JointByteSwap::Swap16Block(values, Pointer, count);
+		Pointer += count * 2;
+		return true;
+	}
+
+	/** Reads a block of doubles in host order */
+	bool ReadDoubles(double *values, size_t count)
+	{
+		if ((size_t)(End - Pointer) < count * 8) return false;
+		JointByteSwap::Swap64Block(values, Pointer, count);
+		Pointer += count * 8;
+		return true;
+	}
+
+	/** Reads values in the given encoding, value i uses scales[i % scaleCount] for fixed point */
+	bool ReadValues(double *values, size_t count, EJointValueEncoding encoding, const float *scales, size_t scaleCount);
+
+	bool ReadSegment(FJointTrajectorySegment &segment)
+	{
+		if ((size_t)(End - Pointer) < JOINT_SEGMENT_SIZE) return false;
+		ReadShort(segment.Id);
+		ReadLong(segment.Start);
+		ReadInt(segment.Duration);
+		return ReadDoubles(segment.Coefficients, JOINT_SEGMENT_COEFFICIENTS);
+	}
+
+	bool ReadHeader(FJointFrameHeader &header)
+	{
+		return ReadByte(header.Type) && ReadInt(header.Sequence) && ReadLong(header.Timestamp)
+			&& ReadInt(header.Echo.Sequence) && ReadLong(header.Echo.Timestamp);
+	}
+
+	/** Reads a label entry, text points into the frame and textLength excludes the terminating null */
+	bool ReadLabel(const char *&text, size_t &textLength)
+	{
+		uint16_t length;
+		if (!ReadShort(length) || End - Pointer < length || length == 0) return false;
+		text = (const char *)Pointer;
+		textLength = length - 1;
+		Pointer += length;
+		return true;
+	}
+};
+
+
+namespace JointCodec
+{
+	/** Protocol v2 state frame. The IDs are already in network order, values hold angle, velocity and effort per joint. */
+	bool EncodeIdState(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const uint16_t *networkIds, const double *values, size_t count, const FJointValueFormat &format = FJointValueFormat());
+
+	/** Protocol v1 state frame, values hold angle, velocity and effort per joint */
+	bool EncodeLabelState(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointLabelEntries &labels, const double *values, size_t count);
+
+	/** Protocol v2 state delta frame, the arguments only cover the joints that changed */
+	bool EncodeIdStateDelta(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const uint16_t *networkIds, const double *values, size_t count, const FJointValueFormat &format = FJointValueFormat());
+
+	/** Protocol v1 state delta frame, the arguments only cover the joints that changed */
+	bool EncodeLabelStateDelta(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointLabelEntries &labels, const double *values, size_t count);
+
+	/** Announces the joint IDs and their labels to the bridge and requests a value encoding */
+	bool EncodeHandshake(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, uint16_t version,
+		const uint16_t *ids, const FJointLabelEntries &labels, size_t count, const FJointValueFormat &format);
+
+	/** Bridge side, protocol v2 command frame with IDs in host order */
+	bool EncodeIdCommand(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const uint16_t *ids, const double *values, size_t count, const FJointValueFormat &format = FJointValueFormat());
+
+	/** Bridge side, protocol v2 trajectory frame */
+	bool EncodeTrajectory(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointTrajectorySegment *segments, size_t count);
+
+	/** Bridge side, protocol v1 command frame */
+	bool EncodeLabelCommand(FJointFrameWriter &writer, uint32_t sequence, uint64_t timestamp, const FJointFrameEcho &echo,
+		const FJointLabelEntries &labels, const double *values, size_t count);
+}
@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointController.h"
+
+
+void FJointControllerBatch::Add(int32 index, bool bVelocity, float position, const FJointControllerSettings &settings)
+{
+	if (ProportionalGain.Num() <= index)
+	{
+		ProportionalGain.SetNumZeroed(index + 1);
+		IntegralGain.SetNumZeroed(index + 1);
+		DerivativeGain.SetNumZeroed(index + 1);
+		IntegralLimit.SetNumZeroed(index + 1);
+		EffortLimit.SetNumZeroed(index + 1);
+		VelocityFeedforward.SetNumZeroed(index + 1);
+		AccelerationFeedforward.SetNumZeroed(index + 1);
+		Reference.SetNumZeroed(index + 1);
+		ReferenceRate.SetNumZeroed(index + 1);
+		ReferenceAcceleration.SetNumZeroed(index + 1);
+		Integral.SetNumZeroed(index + 1);
+		LastVelocity.SetNumZeroed(index + 1);
+		Output.SetNumZeroed(index + 1);
+		while (Controlled.Num() <= index)
+		{
+			Controlled.Add(false);
+		}
+	}
+
+	ProportionalGain[index] = settings.ProportionalGain;
+	IntegralGain[index] = settings.IntegralGain;
+	DerivativeGain[index] = settings.DerivativeGain;
+	IntegralLimit[index] = FMath::Max(settings.IntegralLimit, 0.f);
+	// no limit is the largest one
+	EffortLimit[index] = settings.EffortLimit > 0 ? settings.EffortLimit : MAX_flt;
+	VelocityFeedforward[index] = settings.VelocityFeedforward;
+	AccelerationFeedforward[index] = settings.AccelerationFeedforward;
+
+	Reference[index] = bVelocity ? 0 : position;
+	Controlled[index] = true;
+	(bVelocity ? VelocityJoints : PositionJoints).Add(index);
+}
+
+void FJointControllerBatch::Remove(int32 index)
+{
+	if (!IsControlled(index)) return;
+
+	Controlled[index] = false;
+	PositionJoints.RemoveSingleSwap(index, false);
+	VelocityJoints.RemoveSingleSwap(index, false);
+}
+
+void FJointControllerBatch::SetReference(int32 index, double value, double rate, double acceleration)
+{
+	Reference[index] = value;
+	ReferenceRate[index] = rate;
+	ReferenceAcceleration[index] = acceleration;
+}
+
+void FJointControllerBatch::Update(const float *position, const float *velocity, float deltaTime)
+{
+	if (deltaTime <= 0) return;
+
+	// the error rate comes from the sampled velocity, not from differentiating the error
+	for (int32 i : PositionJoints)
+	{
+		const float error = Reference[i] - position[i];
+		const float errorRate = ReferenceRate[i] - velocity[i];
+		Integral[i] = FMath::Clamp(Integral[i] + IntegralGain[i] * error * deltaTime, -IntegralLimit[i], IntegralLimit[i]);
+
+		const float effort = ProportionalGain[i] * error + Integral[i] + DerivativeGain[i] * errorRate
+			+ VelocityFeedforward[i] * ReferenceRate[i] + AccelerationFeedforward[i] * ReferenceAcceleration[i];
+		Output[i] = FMath::Clamp(effort, -EffortLimit[i], EffortLimit[i]);
+	}
+
+	// the reference is a velocity, its rate is the commanded acceleration
+	for (int32 i : VelocityJoints)
+	{
+		const float error = Reference[i] - velocity[i];
+		const float acceleration = (velocity[i] - LastVelocity[i]) / deltaTime;
+		const float errorRate = ReferenceRate[i] - acceleration;
+		LastVelocity[i] = velocity[i];
+		Integral[i] = FMath::Clamp(Integral[i] + IntegralGain[i] * error * deltaTime, -IntegralLimit[i], IntegralLimit[i]);
+
+		const float effort = ProportionalGain[i] * error + Integral[i] + DerivativeGain[i] * errorRate
+			+ VelocityFeedforward[i] * Reference[i] + AccelerationFeedforward[i] * ReferenceRate[i];
+		Output[i] = FMath::Clamp(effort, -EffortLimit[i], EffortLimit[i]);
+	}
+}
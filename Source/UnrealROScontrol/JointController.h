@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "JointController.generated.h"
+
+
+UENUM(BlueprintType)
+enum class EJointControlEnum : uint8
+{
+	JCE_Drive	UMETA(DisplayName = "Angular drive"),
+	JCE_Pid		UMETA(DisplayName = "PID with feedforward"),
+};
+
+
+/** Gains of the in-plugin controller, efforts in N m */
+USTRUCT(BlueprintType)
+struct FJointControllerSettings
+{
+	GENERATED_BODY()
+
+	/** The angular drive follows commands inside the physics engine, the PID controller applies a twist torque computed by the plugin every physics step */
+	UPROPERTY(EditAnywhere, Category = Controller)
+	EJointControlEnum Mode = EJointControlEnum::JCE_Drive;
+
+	/** Effort per radian of position error, or per rad/s of velocity error for velocity joints */
+	UPROPERTY(EditAnywhere, Category = Controller, meta = (ClampMin = "0", EditCondition = "Mode == EJointControlEnum::JCE_Pid"))
+	float ProportionalGain = 100.f;
+
+	UPROPERTY(EditAnywhere, Category = Controller, meta = (ClampMin = "0", EditCondition = "Mode == EJointControlEnum::JCE_Pid"))
+	float IntegralGain = 0.f;
+
+	/** Effort per unit of error rate */
+	UPROPERTY(EditAnywhere, Category = Controller, meta = (ClampMin = "0", EditCondition = "Mode == EJointControlEnum::JCE_Pid"))
+	float DerivativeGain = 10.f;
+
+	/** Largest effort of the integral term, keeps the integrator from winding up */
+	UPROPERTY(EditAnywhere, Category = Controller, meta = (ClampMin = "0", EditCondition = "Mode == EJointControlEnum::JCE_Pid"))
+	float IntegralLimit = 10.f;
+
+	/** Largest effort the controller applies, 0 for no limit */
+	UPROPERTY(EditAnywhere, Category = Controller, meta = (ClampMin = "0", EditCondition = "Mode == EJointControlEnum::JCE_Pid"))
+	float EffortLimit = 0.f;
+
+	/** Effort per rad/s of the commanded velocity */
+	UPROPERTY(EditAnywhere, Category = Controller, meta = (EditCondition = "Mode == EJointControlEnum::JCE_Pid"))
+	float VelocityFeedforward = 0.f;
+
+	/** Effort per rad/s^2 of the commanded acceleration */
+	UPROPERTY(EditAnywhere, Category = Controller, meta = (EditCondition = "Mode == EJointControlEnum::JCE_Pid"))
+	float AccelerationFeedforward = 0.f;
+};
+
+
+/**
+ * PID controllers with velocity and acceleration feedforward for all joints that use one. Like the
+ * filters, gains and state live in parallel arrays indexed by joint index and every physics step
+ * updates all controllers in one loop per controlled quantity, so the inner loop never leaves the
+ * simulation and transport latency stays out of it.
+ *
+ * Commands set the reference. Trajectory segments also provide its rate and acceleration, plain
+ * commands leave both at zero. A joint holds the angle it had when it registered until the first
+ * command arrives.
+ */
+struct FJointControllerBatch
+{
+	/** Joint indices by controlled quantity */
+	TArray<int32> PositionJoints;
+	TArray<int32> VelocityJoints;
+	/** Joints whose commands go to the controller instead of the angular drive */
+	TBitArray<> Controlled;
+
+	/** Gains, indexed by joint index */
+	TArray<float> ProportionalGain;
+	TArray<float> IntegralGain;
+	TArray<float> DerivativeGain;
+	TArray<float> IntegralLimit;
+	TArray<float> EffortLimit;
+	TArray<float> VelocityFeedforward;
+	TArray<float> AccelerationFeedforward;
+
+	/** Reference and its first two time derivatives */
+	TArray<double> Reference;
+	TArray<double> ReferenceRate;
+	TArray<double> ReferenceAcceleration;
+
+	/** Integral term effort and the velocity of the previous step */
+	TArray<float> Integral;
+	TArray<float> LastVelocity;
+
+	/** Effort of the last update */
+	TArray<float> Output;
+
+	void Add(int32 index, bool bVelocity, float position, const FJointControllerSettings &settings);
+	void Remove(int32 index);
+
+	bool IsControlled(int32 index) const { return Controlled.IsValidIndex(index) && Controlled[index]; }
+	void SetReference(int32 index, double value, double rate, double acceleration);
+
+	/** Computes the effort of every controller from the sampled state */
+	void Update(const float *position, const float *velocity, float deltaTime);
+};
@@ -0,0 +1,94 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointFilter.h"
+
+
+void FJointFilterChannel::Add(int32 index, EJointFilterEnum type, const FJointFilterSettings &settings)
+{
+	if (Taps.Num() <= index)
+	{
+		Taps.SetNumZeroed(index + 1);
+		Cutoff.SetNumZeroed(index + 1);
+		Alpha.SetNumZeroed(index + 1);
+		Beta.SetNumZeroed(index + 1);
+		Value.SetNumZeroed(index + 1);
+		Rate.SetNumZeroed(index + 1);
+		Sum.SetNumZeroed(index + 1);
+		HistoryOffset.SetNumZeroed(index + 1);
+		HistoryPosition.SetNumZeroed(index + 1);
+		HistoryCount.SetNumZeroed(index + 1);
+	}
+
+	switch (type)
+	{
+	case EJointFilterEnum::JFE_MovingAverage:
+		Taps[index] = FMath::Clamp(settings.Taps, 1, 64);
+		HistoryOffset[index] = History.AddZeroed(Taps[index]);
+		HistoryPosition[index] = 0;
+		HistoryCount[index] = 0;
+		Sum[index] = 0;
+		MovingAverage.Add(index);
+		break;
+	case EJointFilterEnum::JFE_LowPass:
+		Cutoff[index] = FMath::Max(settings.CutoffFrequency, 0.01f);
+		LowPass.Add(index);
+		break;
+	case EJointFilterEnum::JFE_AlphaBeta:
+		Alpha[index] = settings.Alpha;
+		Beta[index] = settings.Beta;
+		AlphaBeta.Add(index);
+		break;
+	default:
+		break;
+	}
+}
+
+void FJointFilterChannel::Remove(int32 index)
+{
+	MovingAverage.RemoveSingleSwap(index, false);
+	LowPass.RemoveSingleSwap(index, false);
+	AlphaBeta.RemoveSingleSwap(index, false);
+}
+
+void FJointFilterChannel::Apply(float *values, float deltaTime)
+{
+	if (deltaTime <= 0) return;
+
+	// running sum over a ring of the last Taps samples, kept in double so it does not drift from the window.
+	// The ring starts out zeroed, so until it is full the average only covers the samples seen so far.
+	for (int32 i : MovingAverage)
+	{
+		float *history = History.GetData() + HistoryOffset[i];
+		int32 &position = HistoryPosition[i];
+		int32 &count = HistoryCount[i];
+
+		Sum[i] += (double)values[i] - history[position];
+		history[position] = values[i];
+		position = (position + 1) % Taps[i];
+		count = FMath::Min(count + 1, Taps[i]);
+
+		values[i] = (float)(Sum[i] / count);
+	}
+
+	// y += a * (x - y) with a from the cutoff frequency and the actual step time
+	for (int32 i : LowPass)
+	{
+		float timeConstant = 1.f / (2 * PI * Cutoff[i]);
+		float a = deltaTime / (deltaTime + timeConstant);
+
+		Value[i] += a * (values[i] - Value[i]);
+		values[i] = Value[i];
+	}
+
+	// predict with the tracked rate, then correct value and rate by the residual
+	for (int32 i : AlphaBeta)
+	{
+		float predicted = Value[i] + Rate[i] * deltaTime;
+		float residual = values[i] - predicted;
+
+		Value[i] = predicted + Alpha[i] * residual;
+		Rate[i] += Beta[i] * residual / deltaTime;
+		values[i] = Value[i];
+	}
+}
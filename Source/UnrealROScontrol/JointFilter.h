@@ -0,0 +1,84 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "JointFilter.generated.h"
+
+
+UENUM(BlueprintType)
+enum class EJointFilterEnum : uint8
+{
+	JFE_None			UMETA(DisplayName = "None"),
+	JFE_MovingAverage	UMETA(DisplayName = "Moving average"),
+	JFE_LowPass			UMETA(DisplayName = "First order low-pass"),
+	JFE_AlphaBeta		UMETA(DisplayName = "Alpha-beta tracker"),
+};
+
+
+USTRUCT(BlueprintType)
+struct FJointFilterSettings
+{
+	GENERATED_BODY()
+
+	/** Applied to the finite difference of the unwrapped angle */
+	UPROPERTY(EditAnywhere, Category = Filter)
+	EJointFilterEnum Velocity = EJointFilterEnum::JFE_None;
+
+	/** Applied to the constraint force read from the physics engine */
+	UPROPERTY(EditAnywhere, Category = Filter)
+	EJointFilterEnum Effort = EJointFilterEnum::JFE_None;
+
+	/** Number of samples averaged by the moving average */
+	UPROPERTY(EditAnywhere, Category = Filter, meta = (ClampMin = "1", ClampMax = "64"))
+	int32 Taps = 5;
+
+	/** Cutoff frequency of the low-pass in Hz */
+	UPROPERTY(EditAnywhere, Category = Filter, meta = (ClampMin = "0.01"))
+	float CutoffFrequency = 10.f;
+
+	/** Share of the residual the alpha-beta tracker applies to its value */
+	UPROPERTY(EditAnywhere, Category = Filter, meta = (ClampMin = "0", ClampMax = "1"))
+	float Alpha = 0.5f;
+
+	/** Share of the residual the alpha-beta tracker applies to its rate */
+	UPROPERTY(EditAnywhere, Category = Filter, meta = (ClampMin = "0", ClampMax = "2"))
+	float Beta = 0.1f;
+};
+
+
+/**
+ * Filters one signal of all joints in place. Joints are grouped by filter type and every group runs
+ * as a single loop over the parallel parameter and state arrays, so the cost is one sweep per filter
+ * type instead of one virtual call per joint.
+ */
+struct FJointFilterChannel
+{
+	/** Joint indices using each filter type */
+	TArray<int32> MovingAverage;
+	TArray<int32> LowPass;
+	TArray<int32> AlphaBeta;
+
+	/** Parameters and state, indexed by joint index */
+	TArray<int32> Taps;
+	TArray<float> Cutoff;
+	TArray<float> Alpha;
+	TArray<float> Beta;
+	TArray<float> Value;
+	TArray<float> Rate;
+	/** Running sum of the moving average, in double so the rounding of millions of updates stays below float precision */
+	TArray<double> Sum;
+
+	/** Moving average history, Taps[i] samples starting at HistoryOffset[i] */
+	TArray<float> History;
+	TArray<int32> HistoryOffset;
+	TArray<int32> HistoryPosition;
+	/** Samples in the history so far, the average divides by these until the window is full */
+	TArray<int32> HistoryCount;
+
+	void Add(int32 index, EJointFilterEnum type, const FJointFilterSettings &settings);
+	void Remove(int32 index);
+
+	/** Replaces the raw samples with their filtered values */
+	void Apply(float *values, float deltaTime);
+};
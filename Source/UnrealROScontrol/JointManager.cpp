@@ -3,17 +3,41 @@
 
 #include "JointManager.h"
 
+#include "HAL/RunnableThread.h"
+#include "UnrealROScontrol.h"
+#include "JointPoller.h"
+#include "JointSettings.h"
+
 // Sets default values
 AJointManager::AJointManager()
 {
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
+	// received commands are applied before the physics step
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+
+	ActiveSampling = EJointSamplingEnum::JSE_Timer;
+}
+
+void AJointManager::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
 
+	// joints subscribe from their BeginPlay, which may run before ours
+	UWorld* World = GetWorld();
+	ActiveSampling = Sampling == EJointSamplingEnum::JSE_PhysicsStep && World && World->GetPhysicsScene()
+		? EJointSamplingEnum::JSE_PhysicsStep : EJointSamplingEnum::JSE_Timer;
+	if (ActiveSampling != Sampling)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s has no physics scene to step with, sampling on a timer instead"), *GetName());
+	}
 }
 
 void AJointManager::Subscribe(UJoint *joint)
 {
-	Joints.Emplace(joint->Label, joint);
+	FScopeLock lock(&RegistryLock);
+	if (Registry.Add(joint, joint->bOverrideFilter ? joint->Filter : Filter, ActiveSampling == EJointSamplingEnum::JSE_PhysicsStep) == INDEX_NONE) return;
+	bLabelsDirty = true;
 	UE_LOG(LogTemp, Warning, TEXT("Joint subscribed %s"), *joint->Label);
 
 	//for (auto& Elem : Joints)
@@ -24,7 +48,10 @@ void AJointManager::Subscribe(UJoint *joint)
 
 void AJointManager::Unsubscribe(UJoint *joint)
 {
-	Joints.Remove(joint->Label);
+	FScopeLock lock(&RegistryLock);
+	int32 id = Registry.Remove(joint);
+	Trajectories.Clear(id);
+	bLabelsDirty = true;
 }
 
 // Called when the game starts or when spawned
@@ -32,25 +59,74 @@ void AJointManager::BeginPlay()
 {
 	Super::BeginPlay();
 	
-	Socket = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateSocket(NAME_Stream, TEXT("default"), false);
+	// the sender thread connects, the game thread never waits for the bridge
+	Transport = CreateJointTransport(TransportType, SharedMemoryName, bSharedMemoryWakeup);
+
+	NegotiatedVersion.Set(Protocol == EJointProtocolEnum::JPE_Ids ? 0 : JOINT_PROTOCOL_LABELS);
+	NegotiatedEncoding.Set((int32)EJointValueEncoding::Double);
+	bLabelsDirty = true;
+
+	FJointValueFormat format;
+	format.Encoding = (EJointValueEncoding)ValueEncoding;
+	format.Scales[JOINT_SCALE_ANGLE] = AngleScale;
+	format.Scales[JOINT_SCALE_VELOCITY] = VelocityScale;
+	format.Scales[JOINT_SCALE_EFFORT] = EffortScale;
+	format.Scales[JOINT_SCALE_COMMAND] = CommandScale;
+	if (ValueEncoding == EJointValueEncodingEnum::JVE_Fixed16 && AngleScale * 32767 < PI)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Fixed point angle scale %g only reaches %.3f rad, larger angles are clamped"), AngleScale, AngleScale * 32767);
+	}
 
-	Connect();
+	Sender = MakeUnique<FJointSender>(Transport.Get(), &NegotiatedVersion, &NegotiatedEncoding, &Echo, Protocol == EJointProtocolEnum::JPE_Ids, format,
+		BridgeAddress, BridgePort, ReconnectDelay, MaxReconnectDelay, bDeltaState ? FMath::Max(KeyframeInterval, 1) : 0, DeltaEpsilon);
+	SenderThread = UJointSettings::CreateIOThread(Sender.Get(), TEXT("JointSender"));
+
+	TrajectoryQueue = MakeUnique<TCircularQueue<FJointTrajectoryCommand>>(CommandQueueSize);
+	PlaybackTime = 0;
 
 	UWorld* World = GetWorld();
 	if (World)
 	{
-		World->GetTimerManager().SetTimer(TimerHandle, this, &AJointManager::SendUpdate, 0.02f, true);
+		if (ActiveSampling == EJointSamplingEnum::JSE_PhysicsStep && World->GetPhysicsScene())
+		{
+			// with substepping this is called from the physics thread for every substep
+			PhysicsStepHandle = World->GetPhysicsScene()->OnPhysSceneStep.AddUObject(this, &AJointManager::PhysicsStep);
+		}
+		else
+		{
+			World->GetTimerManager().SetTimer(TimerHandle, this, &AJointManager::SendUpdate, FMath::Max(PublishInterval, 0.001f), true);
+		}
 	}
 
-	RecieveTaskHandle = new FAutoDeleteAsyncTask<RecieveTask>(Socket, &Joints, &bRun);
-	RecieveTaskHandle->StartBackgroundTask();
+	Receiver = MakeUnique<FJointReceiver>(Transport.Get(), &Commands, TrajectoryQueue.Get(), &LabelTable, &NegotiatedVersion, &NegotiatedEncoding, format, &Echo);
+	FUnrealROScontrolModule::Get().GetPoller().Register(Receiver.Get());
 }
 
 void AJointManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
-	Disconnect();
-	*bRun = false;
+
+	UWorld* World = GetWorld();
+	if (World && World->GetPhysicsScene() && PhysicsStepHandle.IsValid())
+	{
+		World->GetPhysicsScene()->OnPhysSceneStep.Remove(PhysicsStepHandle);
+		PhysicsStepHandle.Reset();
+	}
+
+	// a physics step already running finishes first, one that raced the removal finds the sender gone
+	FScopeLock lock(&RegistryLock);
+
+	// closing the socket unblocks a sender stuck in Send or Connect and a poller waiting on it
+	Sender->Stop();
+	Transport->Close();
+
+	FUnrealROScontrolModule::Get().GetPoller().Unregister(Receiver.Get());
+	Receiver.Reset();
+
+	SenderThread->WaitForCompletion();
+	delete SenderThread;
+	SenderThread = nullptr;
+	Sender.Reset();
 }
 
 // Called every frame
@@ -58,121 +134,219 @@ void AJointManager::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-}
+	if (ActiveSampling == EJointSamplingEnum::JSE_Timer)
+	{
+		PlaybackTime += DeltaTime;
+		UpdateLabelTable();
+		ApplyCommands();
+	}
 
+	UpdateStats();
+}
 
-void AJointManager::Connect() {
-	FIPv4Address ip(127, 0, 0, 1);
+void AJointManager::UpdateStats()
+{
+	if (!Sender || !Receiver) return;
 
-	TSharedRef<FInternetAddr> addr = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
-	addr->SetIp(ip.Value);
-	addr->SetPort(8080);
+	double time = FPlatformTime::Seconds();
+	double elapsed = time - LastRateTime;
+	if (elapsed >= 1.0)
+	{
+		int64 framesSent = Sender->Sent.Frames.GetValue();
+		int64 bytesSent = Sender->Sent.Bytes.GetValue();
+		int64 framesReceived = Receiver->Received.Frames.GetValue();
+		int64 bytesReceived = Receiver->Received.Bytes.GetValue();
+
+		PipelineStats.FramesSentPerSecond = (framesSent - LastFramesSent) / elapsed;
+		PipelineStats.BytesSentPerSecond = (bytesSent - LastBytesSent) / elapsed;
+		PipelineStats.FramesReceivedPerSecond = (framesReceived - LastFramesReceived) / elapsed;
+		PipelineStats.BytesReceivedPerSecond = (bytesReceived - LastBytesReceived) / elapsed;
+
+		LastFramesSent = framesSent;
+		LastBytesSent = bytesSent;
+		LastFramesReceived = framesReceived;
+		LastBytesReceived = bytesReceived;
+		LastRateTime = time;
+	}
 
-	bool connected = Socket->Connect(*addr);
-	UE_LOG(LogTemp, Warning, TEXT("START SOCKET! Connected? %s"), (connected ? TEXT("True") : TEXT("False")));
+	// several managers add up their traffic and report their worst latency
+	CSV_CUSTOM_STAT(UnrealROScontrol, FramesSentPerSecond, PipelineStats.FramesSentPerSecond, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(UnrealROScontrol, FramesReceivedPerSecond, PipelineStats.FramesReceivedPerSecond, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(UnrealROScontrol, CommandQueueDepth, CommandQueueDepth.GetValue(), ECsvCustomStatOp::Max);
+	CSV_CUSTOM_STAT(UnrealROScontrol, RoundTripMs, Receiver->Latency.RoundTrip.Last.GetValue() / 1000.0f, ECsvCustomStatOp::Max);
+	CSV_CUSTOM_STAT(UnrealROScontrol, RoundTripP99Ms, Receiver->Latency.RoundTrip.Histogram.GetPercentile(0.99f) / 1000.0f, ECsvCustomStatOp::Max);
+	CSV_CUSTOM_STAT(UnrealROScontrol, OneWayMs, Receiver->Latency.OneWay.Last.GetValue() / 1000.0f, ECsvCustomStatOp::Max);
 }
 
-void AJointManager::Disconnect() {
-	bool status = Socket->Close();
-	UE_LOG(LogTemp, Warning, TEXT("CLSOE SOCKET! Sucessfull? %s"), (status ? TEXT("True") : TEXT("False")));
+void AJointManager::UpdateLabelTable()
+{
+	if (!bLabelsDirty) return;
+
+	LabelTable.Set(Registry.MakeLabelTable());
+	bLabelsDirty = false;
 }
 
+void AJointManager::ApplyCommands()
+{
+	if (!TrajectoryQueue) return;
 
+	JOINT_SCOPE_STAGE(Apply);
+	Commands.Take(TakenCommands);
+	CommandQueueDepth.Set(TakenCommands.Num());
+	SET_DWORD_STAT(STAT_JointCommandQueueDepth, TakenCommands.Num());
 
-void AJointManager::SendUpdate()
-{
-	uint8_t *pointer = buffer;
+	const uint64 now = JointTimestamp();
+	const uint64 deadline = (uint64)(CommandDeadline * 1000000.0);
 
-	*(uint16_t *)pointer = htons(Joints.Num());
-	pointer += 2;
+	for (const FJointCommand &command : TakenCommands)
+	{
+		if (deadline > 0 && now > command.Timestamp && now - command.Timestamp > deadline)
+		{
+			LateCommands.Increment();
+			INC_DWORD_STAT(STAT_JointCommandsLate);
+			continue;
+		}
 
-	for (auto& Elem : Joints)
+		if (Registry.Joints.IsValidIndex(command.Id))
+		{
+			AppliedCommands.Increment();
+			Registry.CommandTarget[command.Id] = command.Value;
+			Registry.CommandRate[command.Id] = 0;
+			Registry.CommandAcceleration[command.Id] = 0;
+			Registry.HasCommand[command.Id] = true;
+			Trajectories.Clear(command.Id);
+		}
+	}
+
+	FJointTrajectoryCommand segment;
+	while (TrajectoryQueue->Dequeue(segment))
 	{
-		UJoint *joint = Elem.Value;
+		if (Registry.Joints.IsValidIndex(segment.Segment.Id) && Registry.Joints[segment.Segment.Id])
+		{
+			Trajectories.Add(segment, PlaybackTime);
+		}
+	}
 
-		double angle = joint->GetAngle();
-		double velocity = joint->GetAngularVelocity();
-		double effort = joint->GetEffort();
+	// once per physics substep in physics step mode, so the setpoints are interpolated at the physics rate
+	Trajectories.Evaluate(PlaybackTime, Registry.CommandTarget, Registry.CommandRate, Registry.CommandAcceleration, Registry.HasCommand);
+	Registry.ApplyCommands();
+}
 
-		char * name = TCHAR_TO_ANSI(*joint->Label);
-		uint16_t length = strlen(name) + 1;
-		*(uint16_t *)pointer = htons(length);
-		pointer += 2;
+FJointPipelineStats AJointManager::GetPipelineStats() const
+{
+	FJointPipelineStats stats = PipelineStats;
+	stats.LateCommands = LateCommands.GetValue();
+	stats.CommandQueueDepth = CommandQueueDepth.GetValue();
+	stats.CoalescedCommands = Commands.Coalesced.GetValue();
+	stats.DroppedSegments = Trajectories.Overflows.GetValue();
+	if (Receiver)
+	{
+		stats.StaleCommands = Receiver->StaleCommands.GetValue();
+		stats.DroppedCommands = Receiver->DroppedCommands.GetValue();
+		stats.SaturatedCommands = Receiver->SaturatedCommands.GetValue();
+	}
+	return stats;
+}
 
-		strcpy_s((char *)pointer, 1024, name);
-		pointer += length;
+static FJointLatencyHistogram MakeHistogram(const FJointHistogram &histogram)
+{
+	FJointLatencyHistogram result;
+	for (int32 i = 0; i < JOINT_HISTOGRAM_BUCKETS; i++)
+	{
+		int64 bound = FJointHistogram::GetUpperBound(i);
+		result.UpperBounds.Add(bound == MAX_int64 ? MAX_flt : bound / 1000.0f);
+		result.Counts.Add(histogram.Buckets[i].GetValue());
+	}
 
-		temp = htonll(*(uint64_t *)&angle);
-		*(uint64_t *)pointer = temp;
-		pointer += 8;
+	int64 median = histogram.GetPercentile(0.5f);
+	int64 percentile99 = histogram.GetPercentile(0.99f);
+	result.Median = median == MAX_int64 ? MAX_flt : median / 1000.0f;
+	result.Percentile99 = percentile99 == MAX_int64 ? MAX_flt : percentile99 / 1000.0f;
+	return result;
+}
 
-		temp = htonll(*(uint64_t *)&velocity);
-		*(uint64_t *)pointer = temp;
-		pointer += 8;
+FJointLatencyHistogram AJointManager::GetRoundTripHistogram() const
+{
+	return Receiver ? MakeHistogram(Receiver->Latency.RoundTrip.Histogram) : FJointLatencyHistogram();
+}
 
-		temp = htonll(*(uint64_t *)&effort);
-		*(uint64_t *)pointer = temp;
-		pointer += 8;
-	}
+FJointLatencyHistogram AJointManager::GetOneWayHistogram() const
+{
+	return Receiver ? MakeHistogram(Receiver->Latency.OneWay.Histogram) : FJointLatencyHistogram();
+}
 
-	int32 sent;
-	bool status = Socket->Send(buffer, pointer - buffer, sent);
-	//if (!status) Disconnect();
-	//ESocketConnectionState state = Socket->GetConnectionState();
-	//if (state != SCS_Connected) Connect();
+FJointLatencyStats AJointManager::GetLatencyStats() const
+{
+	FJointLatencyStats stats;
+	stats.AppliedCommands = AppliedCommands.GetValue();
+	stats.LateCommands = LateCommands.GetValue();
+
+	if (Receiver)
+	{
+		const FJointLatency &latency = Receiver->Latency;
+		stats.RoundTrip = latency.RoundTrip.Last.GetValue() / 1000.0f;
+		stats.AverageRoundTrip = latency.RoundTrip.GetAverage() / 1000.0f;
+		stats.OneWay = latency.OneWay.Last.GetValue() / 1000.0f;
+		stats.AverageOneWay = latency.OneWay.GetAverage() / 1000.0f;
+	}
+	return stats;
 }
 
 
-RecieveTask::RecieveTask(FSocket *Socket, TMap<FString, UJoint *> *Joints,volatile bool **bRun)
+/** Copies without reallocating once the snapshot buffers have grown to the registry size */
+static void CopyValues(TArray<float> &target, const TArray<float> &source)
 {
-	this->Socket = Socket;
-	this->Joints = Joints;
-	*bRun = &this->bRun;
+	target.SetNumUninitialized(source.Num(), false);
+	FMemory::Memcpy(target.GetData(), source.GetData(), source.Num() * sizeof(float));
 }
 
-RecieveTask::~RecieveTask()
+void AJointManager::SendUpdate()
 {
+	UpdateLabelTable();
+
+	double time = FPlatformTime::Seconds();
+	{
+		JOINT_SCOPE_STAGE(Sample);
+		Registry.Sample(LastSampleTime > 0 ? time - LastSampleTime : 0);
+	}
+	LastSampleTime = time;
+
+	Publish();
 }
 
-void RecieveTask::DoWork()
+void AJointManager::PhysicsStep(FPhysScene *PhysScene, float DeltaTime)
 {
-	int32 bytesRead;
-	uint64_t temp;
+	FScopeLock lock(&RegistryLock);
+	if (!Sender || !Receiver) return;
 
-	while (bRun)
+	PlaybackTime += DeltaTime;
+	UpdateLabelTable();
+	ApplyCommands();
+	{
+		JOINT_SCOPE_STAGE(Sample);
+		Registry.Sample(DeltaTime);
+	}
 	{
-		// read number of joints		
-		Socket->Recv(buffer, 2, bytesRead, ESocketReceiveFlags::Type::WaitAll);
-		uint16_t nrJoints = ntohs(*(uint16_t *)buffer);
+		// the inner loop closes here every substep, before the state goes out
+		JOINT_SCOPE_STAGE(Control);
+		Registry.Control(DeltaTime);
+	}
 
-		//UE_LOG(LogTemp, Error, TEXT("test1, %d, %d"), nrJoints, bytesRead);
-		for (int i = 0; i < nrJoints; i++)
-		{
-			//UE_LOG(LogTemp, Error, TEXT("test2"));
-			// read lenght  of label
-			Socket->Recv(buffer, 2, bytesRead, ESocketReceiveFlags::Type::WaitAll);
-			uint16_t labelLenght = ntohs(*(uint16_t *)buffer);
-
-			//UE_LOG(LogTemp, Error, TEXT("test3, %d, %d"), labelLenght, bytesRead);
-			// read label
-			Socket->Recv(buffer, labelLenght, bytesRead, ESocketReceiveFlags::Type::WaitAll);
-			FString label = FString(ANSI_TO_TCHAR((char *)buffer));
-
-			//UE_LOG(LogTemp, Error, TEXT("test4, %d"), bytesRead);
-			// read command
-			Socket->Recv(buffer, 8, bytesRead, ESocketReceiveFlags::Type::WaitAll);
-			temp = ntohll(*(uint64_t *)buffer);
-
-			//UE_LOG(LogTemp, Error, TEXT("test5, %d"), bytesRead);
-			double value = *(double *)&temp;
-			
-			//UE_LOG(LogTemp, Error, TEXT("test6, %d"), value);
-			if (!bRun) return;
-			if ((*Joints).Contains(label))
-			{
-				(*Joints)[label]->ExecuteCommand(value);
-			}
-			//UE_LOG(LogTemp, Error, TEXT("%s: %f"), *label, value);
-		}
+	TimeSincePublish += DeltaTime;
+	if (TimeSincePublish >= PublishInterval)
+	{
+		TimeSincePublish = 0;
+		Publish();
 	}
-}
\ No newline at end of file
+}
+
+void AJointManager::Publish()
+{
+	FJointStateSnapshot &snapshot = Sender->GetWriteBuffer();
+	snapshot.Table = LabelTable.Get();
+	CopyValues(snapshot.Angle, Registry.Position);
+	CopyValues(snapshot.Velocity, Registry.Velocity);
+	CopyValues(snapshot.Effort, Registry.Effort);
+
+	Sender->Publish();
+}
@@ -5,103 +5,310 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "Joint.h"
-#include "Sockets.h"
-#include "SocketSubsystem.h"
-#include "IPAddress.h"
 #include "Networking.h"
+#include "Containers/CircularQueue.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "JointProtocol.h"
+#include "JointRegistry.h"
+#include "JointSender.h"
+#include "JointTransport.h"
+#include "JointReceiver.h"
+#include "JointTrajectory.h"
+#include "JointStats.h"
 #include "JointManager.generated.h"
 
 
-#ifdef _WIN32
-#if PLATFORM_LITTLE_ENDIAN
-#define htons(n) ((((unsigned short)(n) & 0xFF00) >> 8) | (((unsigned short)(n) & 0xFF) << 8))
-#define ntohs(n) ((((unsigned short)(n) & 0xFF00) >> 8) | (((unsigned short)(n) & 0xFF) << 8))
+UENUM(BlueprintType)
+enum class EJointProtocolEnum : uint8
+{
+	JPE_Labels	UMETA(DisplayName = "Labels (v1)"),
+	JPE_Ids		UMETA(DisplayName = "Joint IDs (v2)"),
+};
+
+/** Same order as EJointValueEncoding */
+UENUM(BlueprintType)
+enum class EJointValueEncodingEnum : uint8
+{
+	JVE_Double	UMETA(DisplayName = "Double (64 bit)"),
+	JVE_Float	UMETA(DisplayName = "Float (32 bit)"),
+	JVE_Fixed16	UMETA(DisplayName = "Fixed point (16 bit)"),
+};
+
+UENUM(BlueprintType)
+enum class EJointSamplingEnum : uint8
+{
+	JSE_Timer		UMETA(DisplayName = "Game thread timer"),
+	JSE_PhysicsStep	UMETA(DisplayName = "Physics step"),
+};
 
-#define htonl(n) (((((unsigned long)(n) & 0xFF)) << 24) | \
-                  ((((unsigned long)(n) & 0xFF00)) << 8) | \
-                  ((((unsigned long)(n) & 0xFF0000)) >> 8) | \
-                  ((((unsigned long)(n) & 0xFF000000)) >> 24))
 
-#define ntohl(n) (((((unsigned long)(n) & 0xFF)) << 24) | \
-                  ((((unsigned long)(n) & 0xFF00)) << 8) | \
-                  ((((unsigned long)(n) & 0xFF0000)) >> 8) | \
-                  ((((unsigned long)(n) & 0xFF000000)) >> 24))
+/** Command timing of one manager, latencies in milliseconds */
+USTRUCT(BlueprintType)
+struct FJointLatencyStats
+{
+	GENERATED_BODY()
 
-# define htonll(x) (((uint64_t)htonl((x) & 0xFFFFFFFF) << 32) | htonl((x) >> 32))
-# define ntohll(x) (((uint64_t)ntohl((x) & 0xFFFFFFFF) << 32) | ntohl((x) >> 32))
-#else
-# define htonll(x) (x)
-# define ntohll(x) (x)
-#endif
+	/** State frame sent to command frame received, as seen through the echo in the command */
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	float RoundTrip = 0;
 
-#elif __unix__
-#include <arpa/inet.h>
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	float AverageRoundTrip = 0;
 
-#if __BIG_ENDIAN__
-# define htonll(x) (x)
-# define ntohll(x) (x)
-#else
-# define htonll(x) (((uint64_t)htonl((x) & 0xFFFFFFFF) << 32) | htonl((x) >> 32))
-# define ntohll(x) (((uint64_t)ntohl((x) & 0xFFFFFFFF) << 32) | ntohl((x) >> 32))
-#endif
+	/** Command sent by the bridge to command received, only meaningful with synchronized clocks */
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	float OneWay = 0;
 
-#endif
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	float AverageOneWay = 0;
 
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	int32 AppliedCommands = 0;
+
+	/** Commands dropped because they were older than the deadline when they were due to be applied */
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	int32 LateCommands = 0;
+};
 
-class RecieveTask : public FNonAbandonableTask
+/** Throughput and command losses of one manager, rates are averaged over the last second */
+USTRUCT(BlueprintType)
+struct FJointPipelineStats
 {
-private:
-	FSocket *Socket;
-	uint8_t buffer[1024];
-	TMap<FString, UJoint *> *Joints;
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	float FramesSentPerSecond = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	float BytesSentPerSecond = 0;
 
-	volatile bool bRun = true;
-public:
-	UPROPERTY()
-	RecieveTask(FSocket* Socket, TMap<FString, UJoint *> *Joints, volatile bool **bRun);
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	float FramesReceivedPerSecond = 0;
 
-	~RecieveTask();
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	float BytesReceivedPerSecond = 0;
 
-	// Required by UE4
-	FORCEINLINE TStatId GetStatId() const
-	{
-		RETURN_QUICK_DECLARE_CYCLE_STAT(RecieveTask, STATGROUP_ThreadPoolAsyncTasks)
-	}
+	/** Command frames that arrived after a newer one */
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	int32 StaleCommands = 0;
 
-	void DoWork();
+	/** Trajectory segments that did not fit the queue */
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	int32 DroppedCommands = 0;
+
+	/** Commands replaced by a newer one for the same joint before they were applied */
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	int32 CoalescedCommands = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	int32 LateCommands = 0;
+
+	/** Joints with a command waiting when commands were last applied */
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	int32 CommandQueueDepth = 0;
+
+	/** Trajectory segments dropped because their joint had too many waiting */
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	int32 DroppedSegments = 0;
+
+	/** Fixed point commands at the end of the CommandScale range */
+	UPROPERTY(BlueprintReadOnly, Category = Stats)
+	int32 SaturatedCommands = 0;
 };
 
+/** Latency distribution in milliseconds, the last bucket has no upper bound */
+USTRUCT(BlueprintType)
+struct FJointLatencyHistogram
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	TArray<float> UpperBounds;
+
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	TArray<int32> Counts;
+
+	/** Upper bounds of the buckets holding the median and the 99th percentile */
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	float Median = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = Latency)
+	float Percentile99 = 0;
+};
+
+
 UCLASS()
 class UNREALROSCONTROL_API AJointManager : public AActor
 {
 	GENERATED_BODY()
 	
 private:
-	TMap<FString, UJoint *> Joints;
+	/** Joint state and command targets by joint ID */
+	FJointRegistry Registry;
+	/** Guards the registry when it is sampled from physics substeps off the game thread */
+	FCriticalSection RegistryLock;
+
+	/** Protocol acknowledged by the bridge, 0 while the handshake is still pending */
+	FThreadSafeCounter NegotiatedVersion;
+	/** EJointValueEncoding the bridge acknowledged, doubles until it does */
+	FThreadSafeCounter NegotiatedEncoding;
+	/** Newest command frame, echoed back in state frames */
+	FJointEchoSlot Echo;
 
-	FSocket* Socket;
-	double last_twist;
-	uint8_t buffer[1024];
-	uint64_t temp;
+	FThreadSafeCounter AppliedCommands;
+	FThreadSafeCounter LateCommands;
+	FThreadSafeCounter CommandQueueDepth;
+
+	/** Traffic totals at the last rate update */
+	FJointPipelineStats PipelineStats;
+	double LastRateTime;
+	int64 LastFramesSent;
+	int64 LastBytesSent;
+	int64 LastFramesReceived;
+	int64 LastBytesReceived;
+
+	/** Registered joints as seen by the I/O threads, rebuilt when joints (un)subscribe */
+	FJointLabelTableSlot LabelTable;
+	bool bLabelsDirty;
+
+	/** Newest command per joint from the receiver, taken once per tick before physics runs or once per physics step */
+	FJointCommandMailbox Commands;
+	TArray<FJointCommand> TakenCommands;
+	/** Trajectory segments from the receiver, drained together with the commands */
+	TUniquePtr<TCircularQueue<FJointTrajectoryCommand>> TrajectoryQueue;
+	FJointTrajectoryBuffer Trajectories;
+	/** Simulated seconds since BeginPlay, trajectories are played back on this clock */
+	double PlaybackTime;
+
+	TUniquePtr<IJointTransport> Transport;
+	double LastSampleTime;
+	/** Simulated time since the last state frame in physics step mode */
+	float TimeSincePublish;
 
 	FTimerHandle TimerHandle;
-	FAutoDeleteAsyncTask<RecieveTask> *RecieveTaskHandle;
-	volatile bool *bRun;
+	FDelegateHandle PhysicsStepHandle;
+	/** Sampling in use, the timer stands in for physics step mode without a physics scene. Decided before joints subscribe. */
+	EJointSamplingEnum ActiveSampling;
+	/** Polled by the module's FJointPoller thread */
+	TUniquePtr<FJointReceiver> Receiver;
 
+	TUniquePtr<FJointSender> Sender;
+	FRunnableThread *SenderThread;
+
+	/** Samples all joints with wall clock time and publishes them */
 	UFUNCTION()
 		void SendUpdate();
 
-	void Connect();
-	void Disconnect();
+	/** Applies commands and samples all joints with the simulated step time */
+	void PhysicsStep(FPhysScene *PhysScene, float DeltaTime);
+
+	/** Copies the sampled state for the sender thread, no encoding or networking happens here */
+	void Publish();
+	void UpdateLabelTable();
+	void ApplyCommands();
+	/** Refreshes the rates once per second and reports to the CSV profiler */
+	void UpdateStats();
 
 public:	
+	/** Protocol requested from the bridge. Joint IDs fall back to labels if the bridge only acknowledges v1. */
+	UPROPERTY(EditAnywhere, Category = Protocol)
+	EJointProtocolEnum Protocol = EJointProtocolEnum::JPE_Labels;
+
+	/** Encoding of protocol v2 values requested in the handshake, the bridge may answer with doubles. Protocol v1 always sends doubles. */
+	UPROPERTY(EditAnywhere, Category = Protocol)
+	EJointValueEncodingEnum ValueEncoding = EJointValueEncodingEnum::JVE_Double;
+
+	/** Radians per fixed point step, the largest angle that fits is 32767 steps. Angles are wrapped to [-pi, pi] for fixed point, so the scale must be at least pi / 32767 (0.0000959) to send every angle, smaller ones clamp near +-pi. */
+	UPROPERTY(EditAnywhere, Category = Protocol, meta = (ClampMin = "0.000001", EditCondition = "ValueEncoding == EJointValueEncodingEnum::JVE_Fixed16"))
+	float AngleScale = 0.0001f;
+
+	UPROPERTY(EditAnywhere, Category = Protocol, meta = (ClampMin = "0.000001", EditCondition = "ValueEncoding == EJointValueEncodingEnum::JVE_Fixed16"))
+	float VelocityScale = 0.001f;
+
+	UPROPERTY(EditAnywhere, Category = Protocol, meta = (ClampMin = "0.000001", EditCondition = "ValueEncoding == EJointValueEncodingEnum::JVE_Fixed16"))
+	float EffortScale = 0.01f;
+
+	/** Command units per fixed point step, shared by position and velocity joints. Commands reach 32767 steps (3.28 rad or rad/s at the default), larger ones saturate and are counted and logged once per joint. */
+	UPROPERTY(EditAnywhere, Category = Protocol, meta = (ClampMin = "0.000001", EditCondition = "ValueEncoding == EJointValueEncodingEnum::JVE_Fixed16"))
+	float CommandScale = 0.0001f;
+
+	/** TCP delivers every frame in order. UDP avoids head-of-line blocking and drops frames that arrive late. */
+	UPROPERTY(EditAnywhere, Category = Connection)
+	EJointTransportEnum TransportType = EJointTransportEnum::JTT_Tcp;
+
+	UPROPERTY(EditAnywhere, Category = Connection)
+	FString BridgeAddress = TEXT("127.0.0.1");
+
+	UPROPERTY(EditAnywhere, Category = Connection)
+	int32 BridgePort = 8080;
+
+	/** POSIX shared memory object for the shared memory transport, the bridge opens the same name */
+	UPROPERTY(EditAnywhere, Category = Connection)
+	FString SharedMemoryName = TEXT("/UnrealROScontrol");
+
+	/** Sleep on a futex when the ring is empty, otherwise the reader polls */
+	UPROPERTY(EditAnywhere, Category = Connection)
+	bool bSharedMemoryWakeup = true;
+
+	/** Seconds before the first reconnect attempt, doubled after every failed attempt */
+	UPROPERTY(EditAnywhere, Category = Connection, meta = (ClampMin = "0.01"))
+	float ReconnectDelay = 0.5f;
+
+	UPROPERTY(EditAnywhere, Category = Connection, meta = (ClampMin = "0.01"))
+	float MaxReconnectDelay = 10.0f;
+
+	/** Commands older than this many seconds when they are due to be applied are dropped and counted. 0 applies every command. Needs the bridge clock synchronized with this host. */
+	UPROPERTY(EditAnywhere, Category = Protocol, meta = (ClampMin = "0"))
+	float CommandDeadline = 0;
+
+	/** Number of decoded trajectory segments that can wait for the next tick. Further ones are dropped. Commands never queue up, only the newest per joint waits. */
+	UPROPERTY(EditAnywhere, Category = Protocol, meta = (ClampMin = "16"))
+	int32 CommandQueueSize = 4096;
+
+	/** Leaves joints that did not move out of state frames. The bridge has to understand state delta frames. */
+	UPROPERTY(EditAnywhere, Category = Protocol)
+	bool bDeltaState = false;
+
+	/** Largest change of angle, velocity or effort since a joint was last sent that still counts as not moved */
+	UPROPERTY(EditAnywhere, Category = Protocol, meta = (ClampMin = "0", EditCondition = "bDeltaState"))
+	float DeltaEpsilon = 0.0001f;
+
+	/** Every this many state frames all joints are sent, so a bridge that missed a delta catches up */
+	UPROPERTY(EditAnywhere, Category = Protocol, meta = (ClampMin = "1", EditCondition = "bDeltaState"))
+	int32 KeyframeInterval = 50;
+
+	/** Physics step mode samples every (sub)step with the simulation delta time instead of wall clock time */
+	UPROPERTY(EditAnywhere, Category = Sampling)
+	EJointSamplingEnum Sampling = EJointSamplingEnum::JSE_Timer;
+
+	/** Seconds between state frames. In physics step mode 0 publishes after every step. */
+	UPROPERTY(EditAnywhere, Category = Sampling, meta = (ClampMin = "0"))
+	float PublishInterval = 0.02f;
+
+	/** Velocity and effort filters of all joints that don't override them */
+	UPROPERTY(EditAnywhere, Category = Sampling)
+	FJointFilterSettings Filter;
+
 	// Sets default values for this actor's properties
 	AJointManager();
 
 	void Subscribe(UJoint *joint);
 	void Unsubscribe(UJoint *joint);
 
+	UFUNCTION(BlueprintCallable, Category = Latency)
+	FJointLatencyStats GetLatencyStats() const;
+
+	UFUNCTION(BlueprintCallable, Category = Stats)
+	FJointPipelineStats GetPipelineStats() const;
+
+	UFUNCTION(BlueprintCallable, Category = Latency)
+	FJointLatencyHistogram GetRoundTripHistogram() const;
+
+	UFUNCTION(BlueprintCallable, Category = Latency)
+	FJointLatencyHistogram GetOneWayHistogram() const;
+
 protected:
+	virtual void PostInitializeComponents() override;
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
@@ -0,0 +1,169 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointPoller.h"
+
+#include "HAL/RunnableThread.h"
+#include "Misc/ScopeLock.h"
+#include "JointSettings.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <winsock2.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+typedef WSAPOLLFD FJointPollDescriptor;
+#define JointNativePoll WSAPoll
+#else
+#include <poll.h>
+typedef pollfd FJointPollDescriptor;
+#define JointNativePoll poll
+#endif
+
+
+FJointPoller::FJointPoller()
+	: Thread(nullptr)
+	, bRun(true)
+{
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool();
+}
+
+FJointPoller::~FJointPoller()
+{
+	if (Thread)
+	{
+		Stop();
+		Thread->WaitForCompletion();
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+}
+
+void FJointPoller::Register(FJointReceiver *Receiver)
+{
+	FScopeLock lock(&ReceiversLock);
+	Receivers.AddUnique(Receiver);
+
+	if (!Thread)
+	{
+		Thread = UJointSettings::CreateIOThread(this, TEXT("JointPoller"));
+	}
+	WakeEvent->Trigger();
+}
+
+void FJointPoller::Unregister(FJointReceiver *Receiver)
+{
+	// a wait in progress keeps its descriptors, closing the transport first makes them readable
+	FScopeLock lock(&ReceiversLock);
+	Receivers.Remove(Receiver);
+}
+
+void FJointPoller::Stop()
+{
+	bRun = false;
+	WakeEvent->Trigger();
+}
+
+bool FJointPoller::PollAll()
+{
+	FScopeLock lock(&ReceiversLock);
+
+	bool bRead = false;
+	for (FJointReceiver *receiver : Receivers)
+	{
+		bRead |= receiver->Poll();
+	}
+	return bRead;
+}
+
+void FJointPoller::WaitAll(uint32 &spins)
+{
+	bool bReady = false;
+	bool bPolling = false;
+	{
+		FScopeLock lock(&ReceiversLock);
+		Waiting = Receivers;
+		Handles.Reset();
+		for (FJointReceiver *receiver : Waiting)
+		{
+			bool bReceiverReady;
+			FJointPollHandle handle = receiver->BeginWait(bReceiverReady);
+			bReady |= bReceiverReady;
+			bPolling |= receiver->NeedsPolling(handle);
+			if (handle != JOINT_INVALID_POLL_HANDLE)
+			{
+				Handles.Add(handle);
+			}
+		}
+	}
+
+	if (Waiting.Num() == 0)
+	{
+		// nothing to wait on until the next Register
+		WakeEvent->Wait(MAX_uint32);
+		return;
+	}
+
+	if (!bReady)
+	{
+		if (bPolling)
+		{
+			// a shared memory reader without futex wakeup wants polling, like FJointShmTransport::WaitForPeer
+			if (spins++ < JOINT_POLL_SPIN_COUNT)
+			{
+				FPlatformProcess::YieldThread();
+			}
+			else
+			{
+				FPlatformProcess::Sleep(0.0001f);
+			}
+		}
+		else if (Handles.Num() == 0)
+		{
+			// all disconnected, the sender thread reconnects them
+			FPlatformProcess::Sleep(JOINT_POLL_TIMEOUT_MS / 1000.f);
+		}
+		else
+		{
+			// readable includes a hang up, so shutting a socket down ends the wait as well
+			TArray<FJointPollDescriptor, TInlineAllocator<16>> descriptors;
+			descriptors.AddZeroed(Handles.Num());
+			for (int32 i = 0; i < Handles.Num(); i++)
+			{
+				descriptors[i].fd = Handles[i];
+				descriptors[i].events = POLLIN;
+			}
+			JointNativePoll(descriptors.GetData(), descriptors.Num(), JOINT_POLL_TIMEOUT_MS);
+		}
+	}
+
+	// receivers unregistered during the wait are not touched again
+	FScopeLock lock(&ReceiversLock);
+	for (FJointReceiver *receiver : Waiting)
+	{
+		if (Receivers.Contains(receiver))
+		{
+			receiver->EndWait();
+		}
+	}
+	Waiting.Reset();
+}
+
+uint32 FJointPoller::Run()
+{
+	uint32 spins = 0;
+	while (bRun)
+	{
+		if (PollAll())
+		{
+			spins = 0;
+			continue;
+		}
+
+		WaitAll(spins);
+	}
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "JointReceiver.h"
+
+
+/** Longest the thread waits before it looks at the receiver list again, also bounds how long a reconnected transport goes unnoticed */
+#define JOINT_POLL_TIMEOUT_MS 10
+/** Empty passes before the thread sleeps between checks of a transport that has no descriptor */
+#define JOINT_POLL_SPIN_COUNT 2000
+
+
+/**
+ * One I/O thread for the receivers of all managers, owned by the module. Each pass reads from every
+ * connection that has data, then the thread waits in poll() on the native descriptors of all of
+ * them at once, so the thread count stays the same no matter how many robots are in the level and
+ * a frame is read as soon as it arrives. Shared memory rings take part through their doorbell socket.
+ */
+class FJointPoller : public FRunnable
+{
+private:
+	/** Guards Receivers, held while receivers are polled so Unregister waits for the current pass */
+	FCriticalSection ReceiversLock;
+	TArray<FJointReceiver*> Receivers;
+
+	/** Receivers and descriptors of the current wait, only used by the thread */
+	TArray<FJointReceiver*> Waiting;
+	TArray<FJointPollHandle> Handles;
+
+	FRunnableThread *Thread;
+	FEvent *WakeEvent;
+	FThreadSafeBool bRun;
+
+	/** Polls every receiver once, returns whether any of them read something */
+	bool PollAll();
+	/** Waits until a receiver may have data or the timeout passes */
+	void WaitAll(uint32 &spins);
+
+public:
+	FJointPoller();
+	virtual ~FJointPoller();
+
+	/** Starts polling the receiver, the thread is started with the first one */
+	void Register(FJointReceiver *Receiver);
+	/** After this returns the receiver is never touched again and can be destroyed */
+	void Unregister(FJointReceiver *Receiver);
+
+	//Begin FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+	//End FRunnable interface
+};
@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeLock.h"
+#include "JointCodec.h"
+
+
+/** A decoded joint command, labels of protocol v1 commands are already resolved to the joint ID */
+struct FJointCommand
+{
+	int32 Id;
+	double Value;
+	/** Bridge timestamp of the frame the command came in */
+	uint64 Timestamp;
+};
+
+/** A decoded trajectory segment, its start is still on the bridge clock */
+struct FJointTrajectoryCommand
+{
+	FJointTrajectorySegment Segment;
+	/** Bridge timestamp of the frame the segment came in */
+	uint64 Timestamp;
+};
+
+/**
+ * Newest command per joint, handed from the receiving thread to the one applying commands. A command
+ * for a joint that still has one waiting replaces it, so a backlog collapses to one setpoint per
+ * joint instead of being played back in order.
+ *
+ * Lock free for one poster and one taker, so a slow receiver never blocks the physics step. There
+ * are two batches, one always belongs to the taker. The poster takes the published one out, merges
+ * into it and puts it back. The taker swaps its empty batch for the published one, unless the poster
+ * is just merging, then the commands wait for the next Take.
+ */
+class FJointCommandMailbox
+{
+private:
+	struct FBatch
+	{
+		/** Waiting commands by joint ID */
+		TArray<FJointCommand> Slots;
+		TBitArray<> Waiting;
+		/** IDs of the waiting commands in the order they first arrived */
+		TArray<int32> WaitingIds;
+	};
+
+	FBatch Batches[2];
+	/** Batch the poster merges into, null while it does */
+	FBatch *volatile Published = &Batches[0];
+	/** Empty batch owned by the taker */
+	FBatch *Taken = &Batches[1];
+
+public:
+	/** Commands replaced by a newer one before they were applied */
+	FThreadSafeCounter Coalesced;
+
+	/** Leaves the commands for the next Take, later ones win over earlier ones for the same joint */
+	void Post(const TArray<FJointCommand> &commands)
+	{
+		FBatch *batch = (FBatch*)FPlatformAtomics::InterlockedExchangePtr((void**)&Published, nullptr);
+
+		int32 replaced = 0;
+		for (const FJointCommand &command : commands)
+		{
+			while (batch->Slots.Num() <= command.Id)
+			{
+				batch->Slots.AddUninitialized();
+				batch->Waiting.Add(false);
+			}
+
+			if (batch->Waiting[command.Id])
+			{
+				replaced++;
+			}
+			else
+			{
+				batch->Waiting[command.Id] = true;
+				batch->WaitingIds.Add(command.Id);
+			}
+			batch->Slots[command.Id] = command;
+		}
+		Coalesced.Add(replaced);
+
+		FPlatformAtomics::InterlockedExchangePtr((void**)&Published, batch);
+	}
+
+	/** Replaces the contents of commands with all waiting commands */
+	void Take(TArray<FJointCommand> &commands)
+	{
+		commands.Reset();
+
+		// the batch is only touched after the swap, the poster may be about to take it out
+		FBatch *batch = Published;
+		if (!batch) return;
+		if (FPlatformAtomics::InterlockedCompareExchangePointer((void**)&Published, Taken, batch) != batch) return;
+
+		for (int32 id : batch->WaitingIds)
+		{
+			commands.Add(batch->Slots[id]);
+			batch->Waiting[id] = false;
+		}
+		batch->WaitingIds.Reset();
+		Taken = batch;
+	}
+};
+
+/** Echo handed from the receiving thread to the sending one */
+class FJointEchoSlot
+{
+private:
+	FCriticalSection Lock;
+	FJointFrameEcho Echo;
+
+public:
+	void Set(const FJointFrameEcho &echo)
+	{
+		FScopeLock lock(&Lock);
+		Echo = echo;
+	}
+
+	FJointFrameEcho Get()
+	{
+		FScopeLock lock(&Lock);
+		return Echo;
+	}
+};
+
+
+/**
+ * Microseconds since the Unix epoch. The wall clock is read once and then advanced with the monotonic
+ * clock, so timestamps have microsecond resolution and never jump. One way latencies are only
+ * meaningful if the bridge clock is synchronized, round trips always are.
+ */
+inline uint64_t JointTimestamp()
+{
+	static const double offset = (FDateTime::UtcNow() - FDateTime(1970, 1, 1)).GetTotalMicroseconds() - FPlatformTime::Seconds() * 1000000.0;
+	return (uint64_t)(FPlatformTime::Seconds() * 1000000.0 + offset);
+}
+
+/** True if sequence number a is newer than b, robust against wrap around */
+inline bool IsNewerSequence(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) > 0;
+}
+
+/** Datagrams arriving further behind the newest sequence number than this are taken as a restarted sender */
+#define JOINT_SEQUENCE_WINDOW 1024
@@ -0,0 +1,319 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointReceiver.h"
+
+/** Seconds between warnings about a full trajectory queue */
+#define JOINT_DROP_LOG_INTERVAL 1.0
+
+FJointReceiver::FJointReceiver(IJointTransport *Transport, FJointCommandMailbox *Commands, TCircularQueue<FJointTrajectoryCommand> *Trajectories, FJointLabelTableSlot *LabelTable, FThreadSafeCounter *NegotiatedVersion,
+	FThreadSafeCounter *NegotiatedEncoding, const FJointValueFormat &Format, FJointEchoSlot *Echo)
+	: Transport(Transport)
+	, Used(0)
+	, Commands(Commands)
+	, Trajectories(Trajectories)
+	, LabelTable(LabelTable)
+	, NegotiatedVersion(NegotiatedVersion)
+	, NegotiatedEncoding(NegotiatedEncoding)
+	, Format(Format)
+	, Echo(Echo)
+	, LastSequence(0)
+	, LastTimestamp(0)
+	, bHasSequence(false)
+	, DropsSinceLog(0)
+	, LastDropLogTime(0)
+{
+	Buffer.SetNumUninitialized(1024);
+}
+
+void FJointReceiver::Reset()
+{
+	// a partial frame from the old connection is worthless and a restarted bridge numbers its commands from zero again
+	Used = 0;
+	bHasSequence = false;
+}
+
+FJointPollHandle FJointReceiver::BeginWait(bool &bReady)
+{
+	bReady = false;
+	if (!Transport->IsConnected()) return JOINT_INVALID_POLL_HANDLE;
+
+	return Transport->BeginWait(bReady);
+}
+
+void FJointReceiver::EndWait()
+{
+	Transport->EndWait();
+}
+
+bool FJointReceiver::Poll()
+{
+	// the sender thread reconnects, see FJointSender::UpdateConnection
+	if (!Transport->IsConnected())
+	{
+		Reset();
+		return false;
+	}
+	if (!Transport->WaitForData(0)) return false;
+
+	// pull everything the transport has buffered with a single read,
+	// a datagram that does not fit the buffer would be truncated
+	const int32 minimumRead = Transport->IsDatagram() ? JOINT_MAX_DATAGRAM_SIZE : JOINT_FRAME_HEADER_SIZE;
+	int32 wanted = FMath::Max<int32>(Transport->PendingData(), minimumRead);
+	if (Buffer.Num() - Used < wanted)
+	{
+		Buffer.SetNumUninitialized(Used + wanted);
+	}
+
+	int32 bytesRead = 0;
+	{
+		JOINT_SCOPE_STAGE(Receive);
+		if (!Transport->Recv(Buffer.GetData() + Used, Buffer.Num() - Used, bytesRead))
+		{
+			Reset();
+			return true;
+		}
+	}
+	// only a datagram transport reads nothing without failing
+	if (bytesRead == 0) return false;
+	Used += bytesRead;
+	INC_DWORD_STAT_BY(STAT_JointBytesReceived, bytesRead);
+
+	// decode every complete frame straight from memory
+	JOINT_SCOPE_STAGE(Decode);
+	int32 frames = 0;
+	int32 offset = 0;
+	while (true)
+	{
+		uint32_t length;
+		JointCodec::EFrameStatus status = JointCodec::PeekFrame(Buffer.GetData() + offset, Used - offset, length);
+
+		if (status == JointCodec::EFrameStatus::Invalid)
+		{
+			if (Transport->IsDatagram())
+			{
+				UE_LOG(LogTemp, Error, TEXT("Invalid frame length %u, dropping datagram"), length);
+			}
+			else
+			{
+				// a stream lost its frame boundaries for good, only a new connection starts at one again
+				UE_LOG(LogTemp, Error, TEXT("Invalid frame length %u, reconnecting to resynchronize"), length);
+				Transport->Disconnect();
+			}
+			offset = Used;
+			break;
+		}
+
+		if (status == JointCodec::EFrameStatus::Incomplete)
+		{
+			// frame incomplete, make sure the next read can hold all of it
+			if (Buffer.Num() < (int32)length + 4)
+			{
+				Buffer.SetNumUninitialized(length + 4);
+			}
+			break;
+		}
+
+		DecodeFrame(Buffer.GetData() + offset + 4, length);
+		offset += 4 + length;
+		frames++;
+	}
+	INC_DWORD_STAT_BY(STAT_JointFramesReceived, frames);
+	Received.Add(frames, bytesRead);
+
+	// one hand-over per read, a backlog of frames is already coalesced here
+	if (Decoded.Num() > 0)
+	{
+		const int32 coalesced = Commands->Coalesced.GetValue();
+		Commands->Post(Decoded);
+		INC_DWORD_STAT_BY(STAT_JointCommandsCoalesced, Commands->Coalesced.GetValue() - coalesced);
+		Decoded.Reset();
+	}
+
+	// datagrams carry whole frames, anything left over is garbage
+	if (Transport->IsDatagram())
+	{
+		offset = Used;
+	}
+
+	// keep the partial frame at the start of the buffer
+	if (offset > 0)
+	{
+		FMemory::Memmove(Buffer.GetData(), Buffer.GetData() + offset, Used - offset);
+		Used -= offset;
+	}
+	return true;
+}
+
+void FJointReceiver::DecodeFrame(const uint8_t *frame, uint32_t length)
+{
+	FJointFrameReader reader(frame, length);
+
+	FJointFrameHeader header;
+	if (!reader.ReadHeader(header)) return;
+
+	switch ((EJointFrameType)header.Type)
+	{
+	case EJointFrameType::Handshake:
+	{
+		// bridge answers the handshake with the protocol version it speaks and, if it knows them, the value encoding
+		uint16_t version;
+		if (!reader.ReadShort(version)) break;
+
+		uint8_t encoding = (uint8_t)EJointValueEncoding::Double;
+		if (version == JOINT_PROTOCOL_IDS && reader.ReadByte(encoding) && !JointCodec::IsValidEncoding(encoding))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Bridge chose unknown value encoding %d, using doubles"), encoding);
+			encoding = (uint8_t)EJointValueEncoding::Double;
+		}
+		// the sender starts encoding once it sees the version, so the encoding has to be in place first
+		NegotiatedEncoding->Set(encoding);
+		NegotiatedVersion->Set(version == JOINT_PROTOCOL_IDS ? JOINT_PROTOCOL_IDS : JOINT_PROTOCOL_LABELS);
+		// a restarted bridge counts its command frames from zero again
+		bHasSequence = false;
+		UE_LOG(LogTemp, Warning, TEXT("Bridge acknowledged protocol v%d, value encoding %d"), version, encoding);
+		break;
+	}
+	case EJointFrameType::Trajectory:
+	{
+		// segments address joints by ID, which only a v2 handshake has handed out
+		if (NegotiatedVersion->GetValue() != JOINT_PROTOCOL_IDS) break;
+		if (!AcceptFrame(header)) break;
+
+		uint16_t nrSegments;
+		if (!reader.ReadShort(nrSegments)) break;
+
+		FJointTrajectoryCommand command;
+		command.Timestamp = header.Timestamp;
+		for (int i = 0; i < nrSegments; i++)
+		{
+			if (!reader.ReadSegment(command.Segment)) break;
+			if (!Trajectories->Enqueue(command))
+			{
+				DroppedCommands.Increment();
+				INC_DWORD_STAT(STAT_JointCommandsDropped);
+				DropsSinceLog++;
+			}
+		}
+
+		// a full queue stays full for a while, one line per burst instead of one per segment
+		if (DropsSinceLog > 0)
+		{
+			const double now = FPlatformTime::Seconds();
+			if (now - LastDropLogTime >= JOINT_DROP_LOG_INTERVAL)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Trajectory queue full, dropped %d segments"), DropsSinceLog);
+				DropsSinceLog = 0;
+				LastDropLogTime = now;
+			}
+		}
+		break;
+	}
+	case EJointFrameType::Command:
+	{
+		if (!AcceptFrame(header)) break;
+
+		uint16_t nrJoints;
+		if (!reader.ReadShort(nrJoints)) break;
+
+		FJointCommand command;
+		command.Timestamp = header.Timestamp;
+		if (NegotiatedVersion->GetValue() == JOINT_PROTOCOL_IDS)
+		{
+			// fixed layout, both blocks are converted in one pass each
+			const EJointValueEncoding encoding = (EJointValueEncoding)NegotiatedEncoding->GetValue();
+			CommandIds.SetNumUninitialized(nrJoints, false);
+			CommandValues.SetNumUninitialized(nrJoints, false);
+			if (!reader.ReadShorts(CommandIds.GetData(), nrJoints)
+				|| !reader.ReadValues(CommandValues.GetData(), nrJoints, encoding, &Format.Scales[JOINT_SCALE_COMMAND], 1)) break;
+
+			// IDs the plugin never handed out would only grow the mailbox
+			FJointLabelTablePtr table = LabelTable->Get();
+			const int32 nrIds = table.IsValid() ? table->Labels.Num() : 0;
+			// one scale serves position and velocity joints alike, a command at the end of its range was most likely clamped
+			const double limit = encoding == EJointValueEncoding::Fixed16 ? (32767 - 0.5) * Format.Scales[JOINT_SCALE_COMMAND] : 0;
+			for (int i = 0; i < nrJoints; i++)
+			{
+				command.Id = CommandIds[i];
+				command.Value = CommandValues[i];
+				if (command.Id >= nrIds) continue;
+
+				if (limit > 0 && FMath::Abs(command.Value) >= limit)
+				{
+					SaturatedCommands.Increment();
+					INC_DWORD_STAT(STAT_JointCommandsSaturated);
+					if (command.Id >= SaturationLogged.Num())
+					{
+						SaturationLogged.Add(false, command.Id + 1 - SaturationLogged.Num());
+					}
+					if (!SaturationLogged[command.Id])
+					{
+						SaturationLogged[command.Id] = true;
+						UE_LOG(LogTemp, Warning, TEXT("Command %g for joint %s is at the end of the fixed point range, raise CommandScale if it was clamped"),
+							command.Value, *table->Labels[command.Id]);
+					}
+				}
+				Decoded.Add(command);
+			}
+			break;
+		}
+
+		FJointLabelTablePtr table = LabelTable->Get();
+		FString label;
+		const char *text;
+		size_t textLength;
+		for (int i = 0; i < nrJoints; i++)
+		{
+			if (!reader.ReadLabel(text, textLength)) break;
+			label = FString(textLength, text);
+			const int32 *id = table.IsValid() ? table->Index.Find(label) : nullptr;
+			command.Id = id ? *id : INDEX_NONE;
+
+			if (!reader.ReadDouble(command.Value)) break;
+			if (command.Id == INDEX_NONE) continue;
+
+			// joints are only touched on the game thread, see AJointManager::ApplyCommands
+			Decoded.Add(command);
+		}
+		break;
+	}
+	default:
+		UE_LOG(LogTemp, Error, TEXT("Unknown frame type %d"), header.Type);
+		break;
+	}
+}
+
+bool FJointReceiver::AcceptFrame(const FJointFrameHeader &header)
+{
+	// applying an older command after a newer one would move the joint backwards
+	if (bHasSequence && !IsNewerSequence(header.Sequence, LastSequence))
+	{
+		// a late datagram is older in both sequence and time, a bridge restarted without a handshake (protocol v1 over UDP)
+		// counts from zero again but keeps its clock, or jumps back further than any reordering would
+		const bool bRestarted = header.Timestamp > LastTimestamp || LastSequence - header.Sequence > JOINT_SEQUENCE_WINDOW;
+		if (!bRestarted)
+		{
+			StaleCommands.Increment();
+			INC_DWORD_STAT(STAT_JointCommandsStale);
+			return false;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("Command sequence restarted at %u after %u, bridge restarted"), header.Sequence, LastSequence);
+	}
+	LastSequence = header.Sequence;
+	LastTimestamp = header.Timestamp;
+	bHasSequence = true;
+
+	// the next state frame tells the bridge which command it was sampled after
+	FJointFrameEcho echo;
+	echo.Sequence = header.Sequence;
+	echo.Timestamp = header.Timestamp;
+	Echo->Set(echo);
+
+	uint64 now = JointTimestamp();
+	Latency.OneWay.Add((int64)(now - header.Timestamp));
+	if (header.Echo.Timestamp != 0)
+	{
+		Latency.RoundTrip.Add((int64)(now - header.Echo.Timestamp));
+	}
+	return true;
+}
@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/CircularQueue.h"
+#include "JointTransport.h"
+#include "JointProtocol.h"
+#include "JointRegistry.h"
+#include "JointStats.h"
+
+
+/** Latencies of received command frames */
+struct FJointLatency
+{
+	/** From sending the state frame the bridge echoed to receiving the command, independent of clock offsets */
+	FJointLatencyCounter RoundTrip;
+	/** From the bridge timestamp of the command to receiving it, needs synchronized clocks */
+	FJointLatencyCounter OneWay;
+};
+
+
+/**
+ * Receive side of one manager's connection. Reads whatever its transport has buffered, decodes
+ * complete frames and leaves the newest command per joint in the manager's mailbox. Driven by FJointPoller, which serves
+ * the receivers of all managers from one thread, so Poll never blocks.
+ */
+class FJointReceiver
+{
+private:
+	IJointTransport *Transport;
+	/** Received bytes, grows to hold the largest frame seen so far */
+	TArray<uint8_t> Buffer;
+	/** Bytes in Buffer, a partial frame waits here for the rest */
+	int32 Used;
+	/** Decode scratch for the blocks of protocol v2 command frames */
+	TArray<uint16_t> CommandIds;
+	TArray<double> CommandValues;
+	/** Commands decoded from everything one Poll read, posted together */
+	TArray<FJointCommand> Decoded;
+	/** Newest command per joint for the thread that applies them, this receiver is the only producer */
+	FJointCommandMailbox *Commands;
+	/** Decoded trajectory segments, played back by the manager's FJointTrajectoryBuffer */
+	TCircularQueue<FJointTrajectoryCommand> *Trajectories;
+	/** Resolves the labels of protocol v1 commands to joint IDs */
+	FJointLabelTableSlot *LabelTable;
+	FThreadSafeCounter *NegotiatedVersion;
+	/** EJointValueEncoding the bridge acknowledged, set before NegotiatedVersion */
+	FThreadSafeCounter *NegotiatedEncoding;
+	/** Fixed point scales requested in the handshake */
+	FJointValueFormat Format;
+	/** Newest command frame, echoed back by the sender */
+	FJointEchoSlot *Echo;
+
+	/** Newest command frame applied so far, older ones are stale */
+	uint32 LastSequence;
+	/** Sender timestamp of that frame */
+	uint64 LastTimestamp;
+	bool bHasSequence;
+
+	/** Joint IDs already warned about a fixed point command at the end of the range */
+	TBitArray<> SaturationLogged;
+
+	/** Trajectory segments dropped since the last warning, which goes out at most once per JOINT_DROP_LOG_INTERVAL */
+	int32 DropsSinceLog;
+	double LastDropLogTime;
+
+	/** Forgets everything from a connection that is gone */
+	void Reset();
+
+	/** Decodes one complete frame, length covers the header after the length field and the payload */
+	void DecodeFrame(const uint8_t *frame, uint32_t length);
+
+	/** Drops stale command and trajectory frames, echoes and times the others */
+	bool AcceptFrame(const FJointFrameHeader &header);
+
+public:
+	FJointLatency Latency;
+	FJointTrafficCounter Received;
+	/** Command frames older than one already applied */
+	FThreadSafeCounter StaleCommands;
+	/** Trajectory segments that did not fit their queue, also counted in STAT_JointCommandsDropped */
+	FThreadSafeCounter DroppedCommands;
+	/** Fixed point commands at the end of the range, the bridge's value was probably clamped */
+	FThreadSafeCounter SaturatedCommands;
+
+	FJointReceiver(IJointTransport *Transport, FJointCommandMailbox *Commands, TCircularQueue<FJointTrajectoryCommand> *Trajectories, FJointLabelTableSlot *LabelTable, FThreadSafeCounter *NegotiatedVersion,
+		FThreadSafeCounter *NegotiatedEncoding, const FJointValueFormat &Format, FJointEchoSlot *Echo);
+
+	/** Reads and decodes once if data is ready, returns whether anything was read */
+	bool Poll();
+
+	/** Descriptor for the poller's wait, see IJointTransport::BeginWait. Invalid without a connection. */
+	FJointPollHandle BeginWait(bool &bReady);
+	void EndWait();
+	/** Connected but without a descriptor, the poller then checks again after a short sleep */
+	bool NeedsPolling(FJointPollHandle handle) const { return handle == JOINT_INVALID_POLL_HANDLE && Transport->IsConnected(); }
+};
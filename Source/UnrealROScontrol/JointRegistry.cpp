@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointRegistry.h"
+
+#include "Joint.h"
+
+
+int32 FJointRegistry::Add(UJoint *joint, const FJointFilterSettings &filter, bool bController)
+{
+	if (Joints.Num() >= JOINT_MAX_JOINTS)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Joint %s not registered, a manager hands out at most %d joint IDs per play session"), *joint->Label, JOINT_MAX_JOINTS);
+		return INDEX_NONE;
+	}
+
+	if (LabelToIndex.Contains(joint->Label))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Joint label %s is used twice, commands go to the last joint"), *joint->Label);
+	}
+
+	int32 index = Joints.Add(joint);
+	float twist = joint->GetCurrentTwist();
+	Twist.Add(twist);
+	LastTwist.Add(twist);
+	Position.Add(twist);
+	Velocity.Add(0);
+	Effort.Add(0);
+	CommandTarget.Add(0);
+	CommandRate.Add(0);
+	CommandAcceleration.Add(0);
+	HasCommand.Add(false);
+
+	VelocityFilter.Add(index, filter.Velocity, filter);
+	EffortFilter.Add(index, filter.Effort, filter);
+
+	if (joint->Controller.Mode == EJointControlEnum::JCE_Pid)
+	{
+		if (bController)
+		{
+			Controller.Add(index, joint->JointType == EJointTypeEnum::JTE_Velocity, twist, joint->Controller);
+			joint->DisableDrive();
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Joint %s uses the angular drive, PID control needs physics step sampling"), *joint->Label);
+		}
+	}
+
+	LabelToIndex.Add(joint->Label, index);
+	return index;
+}
+
+int32 FJointRegistry::Remove(UJoint *joint)
+{
+	const int32 *found = LabelToIndex.Find(joint->Label);
+	bool bOwnsLabel = found && Joints[*found] == joint;
+
+	// a joint whose label was taken over by a duplicate is no longer in the map
+	int32 index = bOwnsLabel ? *found : Joints.Find(joint);
+	if (index == INDEX_NONE) return INDEX_NONE;
+
+	Joints[index] = nullptr;
+	HasCommand[index] = false;
+	VelocityFilter.Remove(index);
+	EffortFilter.Remove(index);
+	Controller.Remove(index);
+	if (bOwnsLabel)
+	{
+		LabelToIndex.Remove(joint->Label);
+	}
+	return index;
+}
+
+void FJointRegistry::Sample(float deltaTime)
+{
+	// the only part that has to visit the joint components
+	for (int32 i = 0; i < Joints.Num(); i++)
+	{
+		UJoint *joint = Joints[i];
+		if (!joint) continue;
+
+		Twist[i] = joint->GetCurrentTwist();
+		Effort[i] = joint->GetEffort();
+	}
+
+	const int32 count = Joints.Num();
+	const float inverseDelta = deltaTime > 0 ? 1.f / deltaTime : 0.f;
+	const float* RESTRICT twist = Twist.GetData();
+	float* RESTRICT lastTwist = LastTwist.GetData();
+	float* RESTRICT position = Position.GetData();
+	float* RESTRICT velocity = Velocity.GetData();
+
+	// branch free so the compiler can vectorize it, removed joints just see a zero delta
+	for (int32 i = 0; i < count; i++)
+	{
+		float delta = twist[i] - lastTwist[i];
+		delta -= 2 * PI * FMath::FloorToFloat(delta * (0.5f / PI) + 0.5f);
+
+		position[i] += delta;
+		velocity[i] = delta * inverseDelta;
+		lastTwist[i] = twist[i];
+	}
+
+	VelocityFilter.Apply(velocity, deltaTime);
+	EffortFilter.Apply(Effort.GetData(), deltaTime);
+}
+
+void FJointRegistry::ApplyCommands()
+{
+	for (TConstSetBitIterator<> It(HasCommand); It; ++It)
+	{
+		int32 index = It.GetIndex();
+		if (Controller.IsControlled(index))
+		{
+			Controller.SetReference(index, CommandTarget[index], CommandRate[index], CommandAcceleration[index]);
+		}
+		else if (Joints[index])
+		{
+			Joints[index]->ExecuteCommand(CommandTarget[index]);
+		}
+	}
+	HasCommand.SetRange(0, HasCommand.Num(), false);
+}
+
+void FJointRegistry::Control(float deltaTime)
+{
+	if (Controller.PositionJoints.Num() == 0 && Controller.VelocityJoints.Num() == 0) return;
+
+	Controller.Update(Position.GetData(), Velocity.GetData(), deltaTime);
+
+	// the constraint force of a joint without drive says nothing, the commanded torque is what ros_control expects
+	for (TConstSetBitIterator<> It(Controller.Controlled); It; ++It)
+	{
+		int32 index = It.GetIndex();
+		Joints[index]->ApplyEffort(Controller.Output[index]);
+		Effort[index] = Controller.Output[index];
+	}
+}
+
+FJointLabelTablePtr FJointRegistry::MakeLabelTable() const
+{
+	TSharedRef<FJointLabelTable, ESPMode::ThreadSafe> table = MakeShared<FJointLabelTable, ESPMode::ThreadSafe>();
+	table->Labels.SetNum(Joints.Num());
+
+	for (int32 i = 0; i < Joints.Num(); i++)
+	{
+		if (!Joints[i]) continue;
+
+		table->Ids.Add(i);
+		table->Labels[i] = Joints[i]->Label;
+	}
+	table->Index = LabelToIndex;
+
+	return table;
+}
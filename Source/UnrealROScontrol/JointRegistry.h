@@ -0,0 +1,105 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeLock.h"
+#include "JointFilter.h"
+#include "JointController.h"
+
+class UJoint;
+
+
+/** IDs and joint counts go on the wire as uint16 and freed IDs are not reused, so a manager registers at most this many joints */
+#define JOINT_MAX_JOINTS 65535
+
+
+/** Immutable view of the registered joints handed to the I/O threads */
+struct FJointLabelTable
+{
+	/** IDs of all registered joints in ascending order */
+	TArray<int32> Ids;
+	/** Labels indexed by joint ID, empty for freed IDs */
+	TArray<FString> Labels;
+	/** Resolves the labels of protocol v1 commands */
+	TMap<FString, int32> Index;
+};
+
+typedef TSharedPtr<const FJointLabelTable, ESPMode::ThreadSafe> FJointLabelTablePtr;
+
+
+/** Label table shared with the receive thread, swapped by the game thread whenever the joint set changes */
+class FJointLabelTableSlot
+{
+private:
+	FCriticalSection Lock;
+	FJointLabelTablePtr Table;
+
+public:
+	void Set(const FJointLabelTablePtr &NewTable)
+	{
+		FScopeLock ScopeLock(&Lock);
+		Table = NewTable;
+	}
+
+	FJointLabelTablePtr Get()
+	{
+		FScopeLock ScopeLock(&Lock);
+		return Table;
+	}
+};
+
+
+/**
+ * Dense joint registry. Every joint gets a stable index at Subscribe which doubles as its protocol ID.
+ * Joint state and command targets live in parallel arrays indexed by ID, so the publish and command
+ * paths sweep contiguous memory instead of chasing UJoint pointers. IDs are never reused, removed
+ * joints leave a null slot behind.
+ */
+struct FJointRegistry
+{
+	TArray<UJoint *> Joints;
+
+	/** Raw constraint twist of the current and the previous sample */
+	TArray<float> Twist;
+	TArray<float> LastTwist;
+
+	/** Unwrapped angle */
+	TArray<float> Position;
+	TArray<float> Velocity;
+	TArray<float> Effort;
+
+	FJointFilterChannel VelocityFilter;
+	FJointFilterChannel EffortFilter;
+
+	/** Controllers of joints that use one, fed by the commands and applied after every sample */
+	FJointControllerBatch Controller;
+
+	/** Command value and its rate and acceleration, the latter two are only known for trajectories */
+	TArray<double> CommandTarget;
+	TArray<double> CommandRate;
+	TArray<double> CommandAcceleration;
+	TBitArray<> HasCommand;
+
+	/** Registers a joint and returns its index, INDEX_NONE past JOINT_MAX_JOINTS. Without bController a joint's PID settings are ignored. */
+	int32 Add(UJoint *joint, const FJointFilterSettings &filter, bool bController);
+	/** Frees the index of a joint and returns it, INDEX_NONE if the joint was not registered */
+	int32 Remove(UJoint *joint);
+
+	int32 Num() const { return Joints.Num(); }
+
+	/** Reads every joint's twist and effort, then unwraps, differentiates and filters all joints in batches */
+	void Sample(float deltaTime);
+
+	/** Hands every pending command target to its joint or its controller */
+	void ApplyCommands();
+
+	/** Updates all controllers from the last sample and applies their efforts, which are also reported as the joints' effort */
+	void Control(float deltaTime);
+
+	FJointLabelTablePtr MakeLabelTable() const;
+
+private:
+	/** Only consulted while joints register and unregister */
+	TMap<FString, int32> LabelToIndex;
+};
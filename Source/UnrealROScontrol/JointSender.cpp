@@ -0,0 +1,346 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointSender.h"
+
+#include "HAL/PlatformProcess.h"
+
+
+FJointSender::FJointSender(IJointTransport *Transport, FThreadSafeCounter *NegotiatedVersion, FThreadSafeCounter *NegotiatedEncoding, FJointEchoSlot *Echo, bool bRequestIds, const FJointValueFormat &Format,
+	const FString &Address, int32 Port, float ReconnectDelay, float MaxReconnectDelay, int32 KeyframeInterval, float DeltaEpsilon)
+	: Transport(Transport)
+	, NegotiatedVersion(NegotiatedVersion)
+	, NegotiatedEncoding(NegotiatedEncoding)
+	, Format(Format)
+	, Echo(Echo)
+	, bRequestIds(bRequestIds)
+	, Address(Address)
+	, Port(Port)
+	, ReconnectDelay(FMath::Max(ReconnectDelay, 0.01f))
+	, MaxReconnectDelay(FMath::Max(MaxReconnectDelay, ReconnectDelay))
+	, CurrentDelay(this->ReconnectDelay)
+	, NextConnectTime(0)
+	, bWasConnected(false)
+	, Sequence(0)
+	, HandshakeDelay(this->ReconnectDelay)
+	, NextHandshakeTime(0)
+	, bRun(true)
+	, Labels()
+	, LabelFrameSize(0)
+	, IdFrameSize(0)
+	, KeyframeInterval(FMath::Max(KeyframeInterval, 0))
+	, DeltaEpsilon(FMath::Max(DeltaEpsilon, 0.0f))
+	, FramesSinceKeyframe(0)
+	, DeltaLabels()
+	, DeltaCount(0)
+{
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool();
+}
+
+FJointSender::~FJointSender()
+{
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+}
+
+FJointStateSnapshot &FJointSender::GetWriteBuffer()
+{
+	return Snapshots.GetWriteBuffer();
+}
+
+void FJointSender::Publish()
+{
+	Snapshots.SwapWriteBuffers();
+	WakeEvent->Trigger();
+}
+
+void FJointSender::Stop()
+{
+	bRun = false;
+	WakeEvent->Trigger();
+}
+
+uint32 FJointSender::GetWaitTime() const
+{
+	double wakeup = NextConnectTime;
+	if (Transport->IsConnected())
+	{
+		if (!SentTable.IsValid() || NegotiatedVersion->GetValue() != 0) return MAX_uint32;
+		wakeup = NextHandshakeTime;
+	}
+	return (uint32)FMath::Max(0.0, (wakeup - FPlatformTime::Seconds()) * 1000.0);
+}
+
+void FJointSender::RetryHandshake()
+{
+	if (!bRequestIds || !SentTable.IsValid() || NegotiatedVersion->GetValue() != 0) return;
+
+	double time = FPlatformTime::Seconds();
+	if (time < NextHandshakeTime) return;
+
+	UE_LOG(LogTemp, Log, TEXT("Bridge %s:%d has not answered the handshake, sending it again"), *Address, Port);
+	SendHandshake(*SentTable);
+	NextHandshakeTime = time + HandshakeDelay;
+	HandshakeDelay = FMath::Min(HandshakeDelay * 2, MaxReconnectDelay);
+}
+
+bool FJointSender::UpdateConnection()
+{
+	if (Transport->IsConnected()) return true;
+
+	if (bWasConnected)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Lost connection to bridge %s:%d, reconnecting"), *Address, Port);
+		bWasConnected = false;
+	}
+
+	double time = FPlatformTime::Seconds();
+	if (time < NextConnectTime) return false;
+
+	if (!Transport->Connect(Address, Port))
+	{
+		NextConnectTime = FPlatformTime::Seconds() + CurrentDelay;
+		CurrentDelay = FMath::Min(CurrentDelay * 2, MaxReconnectDelay);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Connected to bridge %s:%d"), *Address, Port);
+	CurrentDelay = ReconnectDelay;
+	bWasConnected = true;
+
+	// a restarted bridge knows nothing about us, negotiate again
+	SentTable.Reset();
+	FramesSinceKeyframe = 0;
+	Echo->Set(FJointFrameEcho());
+	if (bRequestIds)
+	{
+		NegotiatedVersion->Set(0);
+		NegotiatedEncoding->Set((int32)EJointValueEncoding::Double);
+	}
+	return true;
+}
+
+uint32 FJointSender::Run()
+{
+	while (bRun)
+	{
+		WakeEvent->Wait(GetWaitTime());
+		if (!bRun) break;
+		if (!UpdateConnection()) continue;
+		RetryHandshake();
+		if (!Snapshots.IsDirty()) continue;
+
+		Snapshots.SwapReadBuffers();
+		const FJointStateSnapshot &snapshot = Snapshots.Read();
+		if (!snapshot.Table.IsValid()) continue;
+
+		if (snapshot.Table != PreparedTable)
+		{
+			PrepareTable(snapshot.Table);
+		}
+
+		if (bRequestIds && snapshot.Table != SentTable)
+		{
+			SendHandshake(*snapshot.Table);
+			SentTable = snapshot.Table;
+			HandshakeDelay = ReconnectDelay;
+			NextHandshakeTime = FPlatformTime::Seconds() + HandshakeDelay;
+		}
+
+		// bridge has not answered the handshake yet
+		const int32 version = NegotiatedVersion->GetValue();
+		if (version != JOINT_PROTOCOL_LABELS && version != JOINT_PROTOCOL_IDS) continue;
+
+		JOINT_SCOPE_STAGE(Encode);
+		GatherValues(snapshot);
+		const bool bDelta = SelectChangedJoints();
+
+		const int32 count = snapshot.Table->Ids.Num();
+		const bool sent = version == JOINT_PROTOCOL_IDS ? SendIdState(count, bDelta) : SendLabelState(count, bDelta);
+
+		if (sent)
+		{
+			Sent.Frames.Increment();
+			INC_DWORD_STAT(STAT_JointFramesSent);
+		}
+	}
+
+	return 0;
+}
+
+void FJointSender::PrepareTable(const FJointLabelTablePtr &table)
+{
+	const int32 count = table->Ids.Num();
+	// IDs and the joint count are written as uint16, FJointRegistry::Add stops at this limit
+	check(count <= JOINT_MAX_JOINTS && (count == 0 || table->Ids.Last() < JOINT_MAX_JOINTS));
+
+	LabelData.Reset();
+	LabelOffsets.SetNumUninitialized(count);
+	LabelSizes.SetNumUninitialized(count);
+	HandshakeIds.SetNumUninitialized(count);
+	IdBlock.SetNumUninitialized(count);
+
+	int32 largestEntry = 26;
+	for (int32 i = 0; i < count; i++)
+	{
+		int32 id = table->Ids[i];
+		FTCHARToANSI name(*table->Labels[id]);
+
+		LabelSizes[i] = (int32)JointCodec::LabelEntrySize(name.Length());
+		LabelOffsets[i] = LabelData.AddUninitialized(LabelSizes[i]);
+		JointCodec::WriteLabel(LabelData.GetData() + LabelOffsets[i], name.Get(), name.Length());
+		largestEntry = FMath::Max(largestEntry, LabelSizes[i] + 24);
+
+		HandshakeIds[i] = id;
+		IdBlock[i] = JointCodec::ToNetwork16(id);
+	}
+	ValueBlock.SetNumUninitialized(count * 3);
+
+	// the first frame for a new joint set is always a keyframe
+	FramesSinceKeyframe = 0;
+	if (KeyframeInterval > 0)
+	{
+		DeltaReference.SetNumUninitialized(count * 3);
+		DeltaIdBlock.SetNumUninitialized(count);
+		DeltaValueBlock.SetNumUninitialized(count * 3);
+		DeltaLabelOffsets.SetNumUninitialized(count);
+		DeltaLabelSizes.SetNumUninitialized(count);
+	}
+
+	Labels.Data = LabelData.GetData();
+	Labels.Offsets = LabelOffsets.GetData();
+	Labels.Sizes = LabelSizes.GetData();
+	Labels.TotalSize = LabelData.Num();
+
+	LabelFrameSize = (int32)JointCodec::LabelStateFrameSize(Labels, count);
+	IdFrameSize = (int32)JointCodec::IdStateFrameSize(count);
+
+	// whole frames up to the chunk size, larger robots are sent chunk by chunk over streams
+	int32 size = FMath::Max(LabelFrameSize, IdFrameSize);
+	if (!Transport->IsDatagram())
+	{
+		size = FMath::Min(size, JOINT_SEND_CHUNK_SIZE);
+	}
+	size = FMath::Max(size, JOINT_FRAME_HEADER_SIZE + 2 + largestEntry);
+	if (Buffer.Num() < size)
+	{
+		Buffer.SetNumUninitialized(size);
+	}
+
+	PreparedTable = table;
+}
+
+bool FJointSender::Flush(void *context, const uint8_t *data, size_t size)
+{
+	return ((FJointSender *)context)->SendBytes(data, size);
+}
+
+void FJointSender::SendHandshake(const FJointLabelTable &table)
+{
+	// rare, so the frame is encoded with its own allocation and sent whole
+	TArray<uint8_t> frame;
+	frame.SetNumUninitialized(JointCodec::HandshakeFrameSize(Labels, table.Ids.Num()));
+
+	FJointFrameWriter writer(frame.GetData(), frame.Num(), &FJointSender::Flush, this);
+	if (JointCodec::EncodeHandshake(writer, Sequence++, JointTimestamp(), JOINT_PROTOCOL_IDS, HandshakeIds.GetData(), Labels, table.Ids.Num(), Format))
+	{
+		writer.Finish();
+	}
+}
+
+void FJointSender::GatherValues(const FJointStateSnapshot &snapshot)
+{
+	const FJointLabelTable &table = *snapshot.Table;
+	double *values = ValueBlock.GetData();
+
+	// unwrapped positions of a turning joint leave the fixed point range after half a turn, the wrapped angle fits
+	const bool bWrap = NegotiatedEncoding->GetValue() == (int32)EJointValueEncoding::Fixed16;
+	for (int32 i = 0; i < table.Ids.Num(); i++)
+	{
+		int32 id = table.Ids[i];
+		values[i * 3] = bWrap ? FMath::UnwindRadians((double)snapshot.Angle[id]) : snapshot.Angle[id];
+		values[i * 3 + 1] = snapshot.Velocity[id];
+		values[i * 3 + 2] = snapshot.Effort[id];
+	}
+}
+
+bool FJointSender::SelectChangedJoints()
+{
+	if (KeyframeInterval == 0) return false;
+
+	const int32 count = ValueBlock.Num() / 3;
+	const double *values = ValueBlock.GetData();
+	double *reference = DeltaReference.GetData();
+
+	if (FramesSinceKeyframe == 0)
+	{
+		FMemory::Memcpy(reference, values, count * 3 * sizeof(double));
+		FramesSinceKeyframe = KeyframeInterval > 1 ? 1 : 0;
+		return false;
+	}
+	FramesSinceKeyframe = FramesSinceKeyframe + 1 < KeyframeInterval ? FramesSinceKeyframe + 1 : 0;
+
+	// a joint drifting slowly is sent once it is epsilon away from what the bridge has, not from the last sample
+	DeltaCount = 0;
+	size_t labelSize = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		const double *joint = values + i * 3;
+		double *sent = reference + i * 3;
+		if (FMath::Abs(joint[0] - sent[0]) <= DeltaEpsilon
+			&& FMath::Abs(joint[1] - sent[1]) <= DeltaEpsilon
+			&& FMath::Abs(joint[2] - sent[2]) <= DeltaEpsilon)
+		{
+			continue;
+		}
+
+		sent[0] = joint[0];
+		sent[1] = joint[1];
+		sent[2] = joint[2];
+
+		DeltaIdBlock[DeltaCount] = IdBlock[i];
+		DeltaLabelOffsets[DeltaCount] = LabelOffsets[i];
+		DeltaLabelSizes[DeltaCount] = LabelSizes[i];
+		labelSize += LabelSizes[i];
+		FMemory::Memcpy(&DeltaValueBlock[DeltaCount * 3], joint, 3 * sizeof(double));
+		DeltaCount++;
+	}
+
+	DeltaLabels.Data = LabelData.GetData();
+	DeltaLabels.Offsets = DeltaLabelOffsets.GetData();
+	DeltaLabels.Sizes = DeltaLabelSizes.GetData();
+	DeltaLabels.TotalSize = labelSize;
+	return true;
+}
+
+bool FJointSender::SendIdState(int32 count, bool bDelta)
+{
+	FJointValueFormat format = Format;
+	format.Encoding = (EJointValueEncoding)NegotiatedEncoding->GetValue();
+
+	// delta frames still go out when nothing moved, they carry the echo the bridge measures latency with
+	FJointFrameWriter writer(Buffer.GetData(), Buffer.Num(), &FJointSender::Flush, this);
+	bool encoded = bDelta
+		? JointCodec::EncodeIdStateDelta(writer, Sequence++, JointTimestamp(), Echo->Get(), DeltaIdBlock.GetData(), DeltaValueBlock.GetData(), DeltaCount, format)
+		: JointCodec::EncodeIdState(writer, Sequence++, JointTimestamp(), Echo->Get(), IdBlock.GetData(), ValueBlock.GetData(), count, format);
+	return encoded && writer.Finish();
+}
+
+bool FJointSender::SendLabelState(int32 count, bool bDelta)
+{
+	FJointFrameWriter writer(Buffer.GetData(), Buffer.Num(), &FJointSender::Flush, this);
+	bool encoded = bDelta
+		? JointCodec::EncodeLabelStateDelta(writer, Sequence++, JointTimestamp(), Echo->Get(), DeltaLabels, DeltaValueBlock.GetData(), DeltaCount)
+		: JointCodec::EncodeLabelState(writer, Sequence++, JointTimestamp(), Echo->Get(), Labels, ValueBlock.GetData(), count);
+	return encoded && writer.Finish();
+}
+
+bool FJointSender::SendBytes(const uint8_t *data, int32 size)
+{
+	JOINT_SCOPE_STAGE(Send);
+	if (!Transport->Send(data, size)) return false;
+
+	Sent.Bytes.Add(size);
+	INC_DWORD_STAT_BY(STAT_JointBytesSent, size);
+	return true;
+}
@@ -0,0 +1,152 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Containers/TripleBuffer.h"
+#include "JointTransport.h"
+#include "JointProtocol.h"
+#include "JointRegistry.h"
+#include "JointStats.h"
+
+
+/** State frames larger than this are encoded and sent in pieces of this size */
+#define JOINT_SEND_CHUNK_SIZE (64 * 1024)
+
+
+/** Joint state captured on the game thread, encoded and sent by FJointSender */
+struct FJointStateSnapshot
+{
+	/** Registered joints, shared until the joint set changes */
+	FJointLabelTablePtr Table;
+
+	/** Copies of the registry state arrays, indexed by joint ID */
+	TArray<float> Angle;
+	TArray<float> Velocity;
+	TArray<float> Effort;
+};
+
+
+/**
+ * Encodes and sends state frames on its own thread so TCP back-pressure never stalls the game thread.
+ * The game thread only copies joint values into a triple buffered snapshot, the sender always picks
+ * up the newest one and skips snapshots it could not keep up with.
+ *
+ * The sender thread also owns the connection. It connects after start, and whenever the transport
+ * reports a lost connection it reconnects with exponential back-off and sends the handshake again.
+ * An unanswered handshake is repeated with the same back-off. Snapshots published while
+ * disconnected are dropped.
+ *
+ * In delta mode only joints that moved more than an epsilon since they were last sent go into state
+ * delta frames. A full state frame is sent as keyframe every KeyframeInterval frames, after every
+ * (re)connect and whenever the joint set changes, so a bridge that missed a delta catches up.
+ */
+class FJointSender : public FRunnable
+{
+private:
+	IJointTransport *Transport;
+	FThreadSafeCounter *NegotiatedVersion;
+	/** EJointValueEncoding of protocol v2 values, valid once NegotiatedVersion is set */
+	FThreadSafeCounter *NegotiatedEncoding;
+	/** Encoding requested in the handshake and the fixed point scales */
+	FJointValueFormat Format;
+	/** Newest command frame received, echoed in every state frame */
+	FJointEchoSlot *Echo;
+	bool bRequestIds;
+
+	FString Address;
+	int32 Port;
+	/** Back-off between connection attempts, doubles after every failure up to MaxReconnectDelay */
+	float ReconnectDelay;
+	float MaxReconnectDelay;
+	float CurrentDelay;
+	double NextConnectTime;
+	bool bWasConnected;
+
+	/** Sequence number of the next frame */
+	uint32 Sequence;
+
+	TTripleBuffer<FJointStateSnapshot> Snapshots;
+	FEvent *WakeEvent;
+	FThreadSafeBool bRun;
+
+	/** Label table the bridge has last been told about */
+	FJointLabelTablePtr SentTable;
+	/** The handshake or its reply can be lost on UDP, it is repeated with back-off until the bridge answers */
+	float HandshakeDelay;
+	double NextHandshakeTime;
+	/** Label table the encoder state below was prepared for */
+	FJointLabelTablePtr PreparedTable;
+
+	/** Length prefixed ANSI labels of all joints in frame order, encoded once per label table */
+	TArray<uint8_t> LabelData;
+	TArray<int32> LabelOffsets;
+	TArray<int32> LabelSizes;
+	FJointLabelEntries Labels;
+	TArray<uint16_t> HandshakeIds;
+
+	int32 LabelFrameSize;
+	int32 IdFrameSize;
+
+	/** ID block of protocol v2 state frames, already in network byte order */
+	TArray<uint16_t> IdBlock;
+	/** Angle, velocity and effort of every joint gathered for the block byte swap */
+	TArray<double> ValueBlock;
+
+	/** Frames from one keyframe to the next, 0 disables delta frames */
+	int32 KeyframeInterval;
+	float DeltaEpsilon;
+	int32 FramesSinceKeyframe;
+	/** Values of every joint as last sent, in frame order */
+	TArray<double> DeltaReference;
+	/** Changed joints of the current delta frame, compacted like the full blocks */
+	TArray<uint16_t> DeltaIdBlock;
+	TArray<double> DeltaValueBlock;
+	TArray<int32> DeltaLabelOffsets;
+	TArray<int32> DeltaLabelSizes;
+	FJointLabelEntries DeltaLabels;
+	int32 DeltaCount;
+
+	/** Encode buffer, holds a whole state frame or one chunk of it and only grows when the joint set does. Datagram transports always get whole frames. */
+	TArray<uint8_t> Buffer;
+
+	/** Connects when the back-off allows it, returns whether the transport is connected */
+	bool UpdateConnection();
+	/** Milliseconds until the next connection attempt or handshake retry, infinite otherwise */
+	uint32 GetWaitTime() const;
+	/** Repeats the handshake of SentTable while the bridge has not answered it */
+	void RetryHandshake();
+
+	void PrepareTable(const FJointLabelTablePtr &table);
+	void SendHandshake(const FJointLabelTable &table);
+	bool SendLabelState(int32 count, bool bDelta);
+	bool SendIdState(int32 count, bool bDelta);
+	/** Copies the values of all joints in frame order into ValueBlock */
+	void GatherValues(const FJointStateSnapshot &snapshot);
+	/** Decides between keyframe and delta frame, collects the changed joints for the latter */
+	bool SelectChangedJoints();
+
+	/** Sends through the transport and counts the bytes */
+	bool SendBytes(const uint8_t *data, int32 size);
+	/** FJointFrameWriter flush function, sends whenever the encode buffer is full */
+	static bool Flush(void *context, const uint8_t *data, size_t size);
+
+public:
+	/** Complete state frames and all bytes sent */
+	FJointTrafficCounter Sent;
+
+	FJointSender(IJointTransport *Transport, FThreadSafeCounter *NegotiatedVersion, FThreadSafeCounter *NegotiatedEncoding, FJointEchoSlot *Echo, bool bRequestIds, const FJointValueFormat &Format,
+		const FString &Address, int32 Port, float ReconnectDelay, float MaxReconnectDelay, int32 KeyframeInterval, float DeltaEpsilon);
+	virtual ~FJointSender();
+
+	/** Game thread side, fill the returned snapshot and hand it over with Publish() */
+	FJointStateSnapshot &GetWriteBuffer();
+	void Publish();
+
+	//Begin FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+	//End FRunnable interface
+};
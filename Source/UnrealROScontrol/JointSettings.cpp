@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointSettings.h"
+
+#include "HAL/RunnableThread.h"
+
+
+EThreadPriority UJointSettings::GetIOThreadPriority() const
+{
+	switch (IOThreadPriority)
+	{
+	case EJointThreadPriorityEnum::JTP_AboveNormal:
+		return TPri_AboveNormal;
+	case EJointThreadPriorityEnum::JTP_Highest:
+		return TPri_Highest;
+	case EJointThreadPriorityEnum::JTP_TimeCritical:
+		return TPri_TimeCritical;
+	case EJointThreadPriorityEnum::JTP_BelowNormal:
+		return TPri_BelowNormal;
+	default:
+		return TPri_Normal;
+	}
+}
+
+uint64 UJointSettings::GetIOThreadAffinity() const
+{
+	return IOThreadAffinity != 0 ? (uint64)IOThreadAffinity : FPlatformAffinity::GetNoAffinityMask();
+}
+
+FRunnableThread *UJointSettings::CreateIOThread(FRunnable *Runnable, const TCHAR *Name)
+{
+	const UJointSettings *settings = GetDefault<UJointSettings>();
+	return FRunnableThread::Create(Runnable, Name, 0, settings->GetIOThreadPriority(), settings->GetIOThreadAffinity());
+}
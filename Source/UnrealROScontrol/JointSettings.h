@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "HAL/PlatformAffinity.h"
+#include "JointSettings.generated.h"
+
+class FRunnable;
+class FRunnableThread;
+
+
+UENUM()
+enum class EJointThreadPriorityEnum : uint8
+{
+	JTP_Normal			UMETA(DisplayName = "Normal"),
+	JTP_AboveNormal		UMETA(DisplayName = "Above normal"),
+	JTP_Highest			UMETA(DisplayName = "Highest"),
+	JTP_TimeCritical	UMETA(DisplayName = "Time critical"),
+	JTP_BelowNormal		UMETA(DisplayName = "Below normal"),
+};
+
+
+/** Plugin wide settings, shown under Project Settings > Plugins */
+UCLASS(config = Game, defaultconfig, meta = (DisplayName = "UnrealROScontrol"))
+class UNREALROSCONTROL_API UJointSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	/** Priority of the shared receive thread and of every manager's sender thread */
+	UPROPERTY(config, EditAnywhere, Category = Threads)
+	EJointThreadPriorityEnum IOThreadPriority = EJointThreadPriorityEnum::JTP_AboveNormal;
+
+	/** CPU mask for the I/O threads, keeps them away from the cores of the render and physics threads. 0 runs them anywhere. */
+	UPROPERTY(config, EditAnywhere, Category = Threads)
+	int64 IOThreadAffinity = 0;
+
+	EThreadPriority GetIOThreadPriority() const;
+	uint64 GetIOThreadAffinity() const;
+
+	/** Creates an I/O thread with the configured priority and affinity */
+	static FRunnableThread *CreateIOThread(FRunnable *Runnable, const TCHAR *Name);
+};
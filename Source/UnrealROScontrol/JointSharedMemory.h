@@ -0,0 +1,256 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Plain C++ on purpose, the layout is shared with bridges that run outside the engine.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <climits>
+#include <cstdio>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define JOINT_SHM_FUTEX 1
+#endif
+
+
+#define JOINT_SHM_MAGIC 0x4A4F4E54u
+#define JOINT_SHM_VERSION 5
+/** Bytes per direction, a power of two so positions wrap with a mask */
+#define JOINT_SHM_RING_SIZE (1u << 20)
+
+/** FJointShmRing::Waiting bits, a consumer sleeps on the Signal futex or in poll() on its doorbell */
+#define JOINT_SHM_WAITING_FUTEX 1u
+#define JOINT_SHM_WAITING_DOORBELL 2u
+
+
+/**
+ * Single producer single consumer byte ring inside the shared segment. Head and Tail count bytes
+ * ever written and read, so they never wrap in practice and Head - Tail is the fill level. Both
+ * sides carry the same frames as the TCP stream, the ring only replaces the socket.
+ */
+struct FJointShmRing
+{
+	/** Written by the producer only */
+	alignas(64) std::atomic<uint64_t> Head;
+	/** Written by the consumer only */
+	alignas(64) std::atomic<uint64_t> Tail;
+	/** Futex word, bumped by the producer on every publish */
+	alignas(64) std::atomic<uint32_t> Signal;
+	/** JOINT_SHM_WAITING_* bits of a consumer about to sleep, the producer skips the wake syscall otherwise */
+	std::atomic<uint32_t> Waiting;
+	/** Futex word, bumped by the consumer on every read so a producer facing a full ring can sleep */
+	alignas(64) std::atomic<uint32_t> Space;
+	/** Set by a producer about to sleep on Space */
+	std::atomic<uint32_t> SpaceWaiting;
+};
+
+/** Start of the segment, followed by the data of both rings */
+struct FJointShmHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t RingSize;
+	/** Set by either side on shutdown so a blocked peer returns instead of waiting forever */
+	std::atomic<uint32_t> Closed;
+	/** Bumped by every bridge attach and never reset, so each attach gets its own generation */
+	std::atomic<uint32_t> AttachCount;
+	/** Generation of the attached bridge. The bridge zeroes it when it detaches after Magic was cleared, Initialize does so as well. */
+	std::atomic<uint32_t> Attached;
+
+	/** Plugin to bridge, state frames and handshakes */
+	FJointShmRing ToBridge;
+	/** Bridge to plugin, command frames and handshake replies */
+	FJointShmRing FromBridge;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared ring positions must be lock free");
+
+
+namespace JointSharedMemory
+{
+	inline size_t SegmentSize(uint32_t ringSize)
+	{
+		return sizeof(FJointShmHeader) + 2 * (size_t)ringSize;
+	}
+
+	inline uint8_t *RingData(FJointShmHeader *header, const FJointShmRing *ring)
+	{
+		uint8_t *data = (uint8_t*)header + sizeof(FJointShmHeader);
+		return ring == &header->ToBridge ? data : data + header->RingSize;
+	}
+
+	/**
+	 * By the side that created the segment, while nobody uses the rings: with Magic cleared, after the
+	 * peer acknowledged that by clearing Attached and after the own reader left them
+	 */
+	inline void Initialize(FJointShmHeader *header, uint32_t ringSize)
+	{
+		header->RingSize = ringSize;
+		header->Closed.store(0);
+		header->Attached.store(0);
+		FJointShmRing *rings[] = { &header->ToBridge, &header->FromBridge };
+		for (FJointShmRing *ring : rings)
+		{
+			ring->Head.store(0);
+			ring->Tail.store(0);
+			ring->Signal.store(0);
+			ring->Waiting.store(0);
+			ring->Space.store(0);
+			ring->SpaceWaiting.store(0);
+		}
+		header->Version = JOINT_SHM_VERSION;
+		std::atomic_thread_fence(std::memory_order_release);
+		header->Magic = JOINT_SHM_MAGIC;
+	}
+
+	inline void Wake(std::atomic<uint32_t> *word)
+	{
+#if JOINT_SHM_FUTEX
+		// shared between processes, so no FUTEX_PRIVATE_FLAG
+		syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+		(void)word;
+#endif
+	}
+
+	/** Sleeps while the word still holds expected, at most timeoutUs */
+	inline void Wait(std::atomic<uint32_t> *word, uint32_t expected, uint32_t timeoutUs)
+	{
+#if JOINT_SHM_FUTEX
+		timespec timeout = { (time_t)(timeoutUs / 1000000), (long)(timeoutUs % 1000000) * 1000 };
+		syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+#else
+		(void)word; (void)expected; (void)timeoutUs;
+#endif
+	}
+
+	/** Copies as much as fits and publishes it, returns the number of bytes written */
+	inline size_t Write(FJointShmHeader *header, FJointShmRing *ring, const uint8_t *data, size_t size, bool bWake)
+	{
+		const uint64_t head = ring->Head.load(std::memory_order_relaxed);
+		const uint64_t tail = ring->Tail.load(std::memory_order_acquire);
+		const size_t mask = header->RingSize - 1;
+
+		size_t count = header->RingSize - (size_t)(head - tail);
+		if (count > size) count = size;
+		if (count == 0) return 0;
+
+		uint8_t *target = RingData(header, ring);
+		size_t start = (size_t)head & mask;
+		size_t first = header->RingSize - start < count ? header->RingSize - start : count;
+		memcpy(target + start, data, first);
+		memcpy(target, data + first, count - first);
+
+		ring->Head.store(head + count, std::memory_order_release);
+
+		// seq_cst pairs with the consumer setting Waiting before it rechecks Head
+		ring->Signal.fetch_add(1);
+		if (bWake && (ring->Waiting.load() & JOINT_SHM_WAITING_FUTEX))
+		{
+			Wake(&ring->Signal);
+		}
+		return count;
+	}
+
+	/** Copies out up to size bytes and releases them to the producer, returns the number read */
+	inline size_t Read(FJointShmHeader *header, FJointShmRing *ring, uint8_t *data, size_t size)
+	{
+		const uint64_t tail = ring->Tail.load(std::memory_order_relaxed);
+		const uint64_t head = ring->Head.load(std::memory_order_acquire);
+		const size_t mask = header->RingSize - 1;
+
+		size_t count = (size_t)(head - tail);
+		if (count > size) count = size;
+		if (count == 0) return 0;
+
+		const uint8_t *source = RingData(header, ring);
+		size_t start = (size_t)tail & mask;
+		size_t first = header->RingSize - start < count ? header->RingSize - start : count;
+		memcpy(data, source + start, first);
+		memcpy(data + first, source, count - first);
+
+		ring->Tail.store(tail + count, std::memory_order_release);
+
+		// same handshake as Signal, only producers that announced a sleep cost a syscall
+		ring->Space.fetch_add(1);
+		if (ring->SpaceWaiting.load())
+		{
+			Wake(&ring->Space);
+		}
+		return count;
+	}
+
+	inline size_t Pending(const FJointShmRing *ring)
+	{
+		return (size_t)(ring->Head.load(std::memory_order_acquire) - ring->Tail.load(std::memory_order_relaxed));
+	}
+
+	/** Bytes the producer can write right now */
+	inline size_t Free(const FJointShmHeader *header, const FJointShmRing *ring)
+	{
+		return header->RingSize - (size_t)(ring->Head.load(std::memory_order_relaxed) - ring->Tail.load(std::memory_order_acquire));
+	}
+
+#if JOINT_SHM_FUTEX
+	/**
+	 * A futex can't be waited on together with sockets, so a consumer that multiplexes several
+	 * connections in poll() sets JOINT_SHM_WAITING_DOORBELL instead and the producer sends a byte
+	 * to an abstract unix datagram socket named after the segment.
+	 */
+	struct FDoorbell
+	{
+		int Socket = -1;
+		sockaddr_un Address;
+		socklen_t AddressSize = 0;
+	};
+
+	inline bool OpenDoorbell(FDoorbell &doorbell, const char *segmentName, bool bReceiver)
+	{
+		memset(&doorbell.Address, 0, sizeof(doorbell.Address));
+		doorbell.Address.sun_family = AF_UNIX;
+		int length = snprintf(doorbell.Address.sun_path + 1, sizeof(doorbell.Address.sun_path) - 1, "%s.doorbell", segmentName);
+		doorbell.AddressSize = (socklen_t)(offsetof(sockaddr_un, sun_path) + 1 + length);
+
+		doorbell.Socket = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (doorbell.Socket >= 0 && bReceiver && bind(doorbell.Socket, (const sockaddr*)&doorbell.Address, doorbell.AddressSize) != 0)
+		{
+			close(doorbell.Socket);
+			doorbell.Socket = -1;
+		}
+		return doorbell.Socket >= 0;
+	}
+
+	inline void CloseDoorbell(FDoorbell &doorbell)
+	{
+		if (doorbell.Socket >= 0) close(doorbell.Socket);
+		doorbell.Socket = -1;
+	}
+
+	/** Producer side, after Write, rings only for a consumer that announced it waits on the doorbell */
+	inline void RingDoorbell(const FDoorbell &doorbell, const FJointShmRing *ring)
+	{
+		if (doorbell.Socket < 0 || !(ring->Waiting.load() & JOINT_SHM_WAITING_DOORBELL)) return;
+
+		// a full socket buffer means the consumer has not drained earlier rings yet, so it is awake anyway
+		const uint8_t byte = 0;
+		sendto(doorbell.Socket, &byte, 1, MSG_DONTWAIT | MSG_NOSIGNAL, (const sockaddr*)&doorbell.Address, doorbell.AddressSize);
+	}
+
+	inline void DrainDoorbell(const FDoorbell &doorbell)
+	{
+		uint8_t bytes[64];
+		while (doorbell.Socket >= 0 && recv(doorbell.Socket, bytes, sizeof(bytes), MSG_DONTWAIT) > 0)
+		{
+		}
+	}
+#endif
+}
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointStats.h"
+
+
+DEFINE_STAT(STAT_JointReceive);
+DEFINE_STAT(STAT_JointDecode);
+DEFINE_STAT(STAT_JointApply);
+DEFINE_STAT(STAT_JointSample);
+DEFINE_STAT(STAT_JointControl);
+DEFINE_STAT(STAT_JointEncode);
+DEFINE_STAT(STAT_JointSend);
+
+DEFINE_STAT(STAT_JointFramesSent);
+DEFINE_STAT(STAT_JointBytesSent);
+DEFINE_STAT(STAT_JointFramesReceived);
+DEFINE_STAT(STAT_JointBytesReceived);
+DEFINE_STAT(STAT_JointCommandsDropped);
+DEFINE_STAT(STAT_JointCommandsStale);
+DEFINE_STAT(STAT_JointCommandsLate);
+DEFINE_STAT(STAT_JointCommandsCoalesced);
+DEFINE_STAT(STAT_JointCommandsSaturated);
+DEFINE_STAT(STAT_JointCommandQueueDepth);
+
+CSV_DEFINE_CATEGORY_MODULE(UNREALROSCONTROL_API, UnrealROScontrol, true);
+
+
+static const int64 HistogramBounds[JOINT_HISTOGRAM_BUCKETS - 1] = JOINT_HISTOGRAM_BOUNDS;
+
+int32 FJointHistogram::GetBucket(int64 value)
+{
+	int32 bucket = 0;
+	while (bucket < JOINT_HISTOGRAM_BUCKETS - 1 && value > HistogramBounds[bucket])
+	{
+		bucket++;
+	}
+	return bucket;
+}
+
+int64 FJointHistogram::GetUpperBound(int32 bucket)
+{
+	return bucket < JOINT_HISTOGRAM_BUCKETS - 1 ? HistogramBounds[bucket] : MAX_int64;
+}
+
+int64 FJointHistogram::GetPercentile(float fraction) const
+{
+	int64 total = 0;
+	for (const FThreadSafeCounter &bucket : Buckets)
+	{
+		total += bucket.GetValue();
+	}
+	if (total == 0) return 0;
+
+	int64 wanted = FMath::CeilToInt(total * fraction);
+	int64 count = 0;
+	for (int32 i = 0; i < JOINT_HISTOGRAM_BUCKETS; i++)
+	{
+		count += Buckets[i].GetValue();
+		if (count >= wanted) return GetUpperBound(i);
+	}
+	return GetUpperBound(JOINT_HISTOGRAM_BUCKETS - 1);
+}
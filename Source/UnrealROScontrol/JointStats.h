@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "HAL/ThreadSafeCounter64.h"
+
+
+DECLARE_STATS_GROUP(TEXT("UnrealROScontrol"), STATGROUP_UnrealROScontrol, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Receive"), STAT_JointReceive, STATGROUP_UnrealROScontrol, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decode"), STAT_JointDecode, STATGROUP_UnrealROScontrol, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Apply"), STAT_JointApply, STATGROUP_UnrealROScontrol, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Sample"), STAT_JointSample, STATGROUP_UnrealROScontrol, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Control"), STAT_JointControl, STATGROUP_UnrealROScontrol, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Encode"), STAT_JointEncode, STATGROUP_UnrealROScontrol, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Send"), STAT_JointSend, STATGROUP_UnrealROScontrol, );
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Frames sent"), STAT_JointFramesSent, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes sent"), STAT_JointBytesSent, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Frames received"), STAT_JointFramesReceived, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes received"), STAT_JointBytesReceived, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Commands dropped (queue full)"), STAT_JointCommandsDropped, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Commands stale"), STAT_JointCommandsStale, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Commands late"), STAT_JointCommandsLate, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Commands coalesced"), STAT_JointCommandsCoalesced, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Commands saturated (fixed point)"), STAT_JointCommandsSaturated, STATGROUP_UnrealROScontrol, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Command queue depth"), STAT_JointCommandQueueDepth, STATGROUP_UnrealROScontrol, );
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(UNREALROSCONTROL_API, UnrealROScontrol);
+
+/** Cycle stat and CSV profiler timing for one pipeline stage, both compile out when disabled */
+#define JOINT_SCOPE_STAGE(Stage) \
+	SCOPE_CYCLE_COUNTER(STAT_Joint##Stage); \
+	CSV_SCOPED_TIMING_STAT(UnrealROScontrol, Stage)
+
+
+/** Upper bounds in microseconds of all latency histogram buckets but the last, which is open */
+#define JOINT_HISTOGRAM_BOUNDS { 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000 }
+#define JOINT_HISTOGRAM_BUCKETS 12
+
+
+/** Counts latencies in fixed buckets, updated by one thread and read by any */
+struct FJointHistogram
+{
+	FThreadSafeCounter Buckets[JOINT_HISTOGRAM_BUCKETS];
+
+	static int32 GetBucket(int64 value);
+	/** Upper bound of a bucket in microseconds, MAX_int64 for the last */
+	static int64 GetUpperBound(int32 bucket);
+
+	void Add(int64 value)
+	{
+		Buckets[GetBucket(value)].Increment();
+	}
+
+	/** Upper bound of the bucket that holds the given fraction of all values, 0 while empty */
+	int64 GetPercentile(float fraction) const;
+};
+
+/** Running sum, count, last value and histogram of a latency in microseconds, updated by one thread */
+struct FJointLatencyCounter
+{
+	FThreadSafeCounter64 Sum;
+	FThreadSafeCounter64 Count;
+	FThreadSafeCounter64 Last;
+	FJointHistogram Histogram;
+
+	void Add(int64 value)
+	{
+		Sum.Add(value);
+		Count.Increment();
+		Last.Set(value);
+		Histogram.Add(value);
+	}
+
+	double GetAverage() const
+	{
+		int64 count = Count.GetValue();
+		return count > 0 ? (double)Sum.GetValue() / count : 0;
+	}
+};
+
+/** Frames and bytes moved over one connection in one direction */
+struct FJointTrafficCounter
+{
+	FThreadSafeCounter64 Frames;
+	FThreadSafeCounter64 Bytes;
+
+	void Add(int64 frames, int64 bytes)
+	{
+		Frames.Add(frames);
+		Bytes.Add(bytes);
+	}
+};
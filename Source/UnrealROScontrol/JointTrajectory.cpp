@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointTrajectory.h"
+
+
+FJointTrajectoryBuffer::FJointTrajectoryBuffer()
+	: ActiveCount(0)
+	, AnchorTimestamp(0)
+	, AnchorTime(0)
+{
+}
+
+void FJointTrajectoryBuffer::Add(const FJointTrajectoryCommand &command, double playbackTime)
+{
+	const int32 id = command.Segment.Id;
+	if (Segments.Num() <= id)
+	{
+		Segments.SetNum(id + 1);
+		while (Active.Num() <= id)
+		{
+			Active.Add(false);
+		}
+	}
+
+	if (ActiveCount == 0)
+	{
+		AnchorTimestamp = command.Timestamp;
+		AnchorTime = playbackTime;
+	}
+
+	FSegment segment;
+	segment.Start = AnchorTime + (int64)(command.Segment.Start - AnchorTimestamp) / 1000000.0;
+	segment.Duration = command.Segment.Duration / 1000000.0;
+	FMemory::Memcpy(segment.Coefficients, command.Segment.Coefficients, sizeof(segment.Coefficients));
+
+	auto &joint = Segments[id];
+	while (joint.Num() > 0 && joint.Last().Start >= segment.Start)
+	{
+		joint.Pop(false);
+	}
+	if (joint.Num() >= JOINT_TRAJECTORY_CAPACITY)
+	{
+		Overflows.Increment();
+		return;
+	}
+	joint.Add(segment);
+
+	if (!Active[id])
+	{
+		Active[id] = true;
+		ActiveCount++;
+	}
+}
+
+void FJointTrajectoryBuffer::Clear(int32 id)
+{
+	if (!Active.IsValidIndex(id) || !Active[id]) return;
+
+	Segments[id].Reset();
+	Active[id] = false;
+	ActiveCount--;
+}
+
+void FJointTrajectoryBuffer::Evaluate(double playbackTime, TArray<double> &targets, TArray<double> &rates, TArray<double> &accelerations, TBitArray<> &hasTarget)
+{
+	if (ActiveCount == 0) return;
+
+	TArray<int32, TInlineAllocator<16>> finished;
+	for (TConstSetBitIterator<> It(Active); It; ++It)
+	{
+		const int32 id = It.GetIndex();
+		auto &joint = Segments[id];
+
+		// a segment is done once the next one has started
+		int32 current = 0;
+		while (current + 1 < joint.Num() && joint[current + 1].Start <= playbackTime)
+		{
+			current++;
+		}
+		if (current > 0)
+		{
+			joint.RemoveAt(0, current, false);
+		}
+
+		// the joint keeps its previous setpoint until the first segment starts
+		const FSegment &segment = joint[0];
+		if (playbackTime < segment.Start) continue;
+
+		hasTarget[id] = true;
+		if (playbackTime - segment.Start < segment.Duration)
+		{
+			JointCodec::EvaluateSegment(segment.Coefficients, playbackTime - segment.Start, targets[id], rates[id], accelerations[id]);
+			continue;
+		}
+
+		// past its end the joint rests at the end value
+		targets[id] = JointCodec::EvaluateSegment(segment.Coefficients, segment.Duration);
+		rates[id] = 0;
+		accelerations[id] = 0;
+		if (joint.Num() == 1)
+		{
+			finished.Add(id);
+		}
+	}
+
+	for (int32 id : finished)
+	{
+		Clear(id);
+	}
+}
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "JointProtocol.h"
+
+
+/** Segments a joint can have waiting, a bridge planning further ahead loses the last ones */
+#define JOINT_TRAJECTORY_CAPACITY 32
+
+
+/**
+ * Plays back trajectory segments on the playback clock of a manager, simulated seconds that advance
+ * with every physics step or tick, and writes the command value of every playing joint each step.
+ * The bridge only has to send segments ahead of time instead of setpoints at the control rate.
+ *
+ * Segment starts are on the bridge clock. The first segment that arrives while no joint is playing
+ * anchors the two clocks, the timestamp of its frame becomes the current playback time. Consecutive
+ * segments then join without gaps no matter how the frames were delayed on the way, and no clock
+ * synchronization is needed. The anchor is renewed once all trajectories have run out.
+ *
+ * A segment replaces the buffered segments of its joint that start at the same time or later, so the
+ * bridge can revise its plan. A joint holds the end value of its last segment.
+ */
+class FJointTrajectoryBuffer
+{
+private:
+	struct FSegment
+	{
+		/** Playback time in seconds */
+		double Start;
+		double Duration;
+		double Coefficients[JOINT_SEGMENT_COEFFICIENTS];
+	};
+
+	/** Waiting and playing segments by joint ID, in order of their start */
+	TArray<TArray<FSegment, TInlineAllocator<4>>> Segments;
+	/** Joints with at least one segment */
+	TBitArray<> Active;
+	int32 ActiveCount;
+
+	uint64 AnchorTimestamp;
+	double AnchorTime;
+
+public:
+	/** Segments dropped because their joint had JOINT_TRAJECTORY_CAPACITY waiting */
+	FThreadSafeCounter Overflows;
+
+	FJointTrajectoryBuffer();
+
+	/** Buffers a segment of a registered joint */
+	void Add(const FJointTrajectoryCommand &command, double playbackTime);
+	/** Stops the trajectory of a joint, a direct command or a new joint takes over */
+	void Clear(int32 id);
+	/** Writes the command values of all playing joints at the given playback time, with their rate and acceleration for the controllers */
+	void Evaluate(double playbackTime, TArray<double> &targets, TArray<double> &rates, TArray<double> &accelerations, TBitArray<> &hasTarget);
+};
@@ -0,0 +1,495 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JointTransport.h"
+
+#include "SocketSubsystem.h"
+#include "IPAddress.h"
+#include "BSDSockets/SocketsBSD.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/ScopeRWLock.h"
+
+#if PLATFORM_LINUX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** Empty polls before a shared memory reader goes to sleep, cheaper than a futex round trip for 1 kHz loops */
+#define JOINT_SHM_SPIN_COUNT 2000
+/** Upper bound for one futex sleep, so a missed wake only costs this much */
+#define JOINT_SHM_WAIT_US 100000
+/** Seconds the bridge may leave its ring full before it counts as gone */
+#define JOINT_SHM_SEND_TIMEOUT 2.0
+
+
+FJointSocketTransport::FJointSocketTransport(bool bDatagram)
+	: Socket(nullptr)
+	, bDatagram(bDatagram)
+	, bConnected(false)
+	, bClosed(false)
+{
+}
+
+FJointSocketTransport::~FJointSocketTransport()
+{
+	if (Socket)
+	{
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+	}
+}
+
+void FJointSocketTransport::Shutdown()
+{
+	bConnected = false;
+
+	FScopeLock lock(&SocketLock);
+	if (Socket)
+	{
+		Socket->Shutdown(ESocketShutdownMode::ReadWrite);
+	}
+}
+
+bool FJointSocketTransport::Connect(const FString &Address, int32 Port)
+{
+	FIPv4Address ip;
+	if (!FIPv4Address::Parse(Address, ip))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Invalid bridge address %s"), *Address);
+		return false;
+	}
+
+	ISocketSubsystem *SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	TSharedRef<FInternetAddr> addr = SocketSubsystem->CreateInternetAddr();
+	addr->SetIp(ip.Value);
+	addr->SetPort(Port);
+
+	// the receive thread leaves Recv on the old socket once it is shut down
+	Shutdown();
+	FRWScopeLock usage(SocketUsage, SLT_Write);
+
+	{
+		FScopeLock lock(&SocketLock);
+		if (bClosed) return false;
+
+		if (Socket)
+		{
+			SocketSubsystem->DestroySocket(Socket);
+		}
+		Socket = SocketSubsystem->CreateSocket(bDatagram ? NAME_DGram : NAME_Stream, TEXT("JointTransport"), false);
+		if (!Socket) return false;
+
+		if (bDatagram)
+		{
+			// a burst of state frames must not overflow the kernel buffer before the bridge reads them
+			int32 newSize;
+			Socket->SetReceiveBufferSize(4 * JOINT_MAX_DATAGRAM_SIZE, newSize);
+			Socket->SetSendBufferSize(4 * JOINT_MAX_DATAGRAM_SIZE, newSize);
+		}
+	}
+
+	// connect without blocking so an unreachable bridge costs at most the timeout,
+	// for UDP this only fixes the peer so Send and Recv work without addresses
+	Socket->SetNonBlocking(true);
+	Socket->Connect(*addr);
+	bool connected = Socket->Wait(ESocketWaitConditions::WaitForWrite, FTimespan::FromSeconds(JOINT_CONNECT_TIMEOUT))
+		&& Socket->GetConnectionState() == SCS_Connected;
+	Socket->SetNonBlocking(false);
+
+	bConnected = connected;
+	return connected;
+}
+
+void FJointSocketTransport::Close()
+{
+	FScopeLock lock(&SocketLock);
+	bClosed = true;
+	bConnected = false;
+	if (Socket)
+	{
+		Socket->Shutdown(ESocketShutdownMode::ReadWrite);
+		Socket->Close();
+	}
+}
+
+bool FJointSocketTransport::Send(const uint8_t *data, int32 size)
+{
+	if (bDatagram && size > JOINT_MAX_DATAGRAM_SIZE)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Frame of %d bytes does not fit a datagram, use TCP for this many joints"), size);
+		return false;
+	}
+
+	FRWScopeLock usage(SocketUsage, SLT_ReadOnly);
+	if (!bConnected) return false;
+
+	while (size > 0)
+	{
+		int32 sent = 0;
+		if (!Socket->Send(data, size, sent) || sent <= 0)
+		{
+			bConnected = false;
+			return false;
+		}
+
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+bool FJointSocketTransport::Recv(uint8_t *data, int32 size, int32 &bytesRead)
+{
+	FRWScopeLock usage(SocketUsage, SLT_ReadOnly);
+	if (!bConnected) return false;
+
+	if (!Socket->Recv(data, size, bytesRead))
+	{
+		// a datagram socket has no connection to lose, nothing to read or a bridge that isn't up yet are not errors
+		if (bDatagram)
+		{
+			const ESocketErrors error = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->GetLastErrorCode();
+			if (error == SE_EWOULDBLOCK || error == SE_ECONNREFUSED || error == SE_ECONNRESET)
+			{
+				bytesRead = 0;
+				return true;
+			}
+		}
+		bConnected = false;
+		return false;
+	}
+
+	// a stream returns 0 bytes once the bridge closed its end, a datagram may just be empty
+	if (bytesRead <= 0 && !bDatagram)
+	{
+		bConnected = false;
+		return false;
+	}
+	return true;
+}
+
+uint32 FJointSocketTransport::PendingData()
+{
+	FRWScopeLock usage(SocketUsage, SLT_ReadOnly);
+	uint32 pendingSize = 0;
+	if (bConnected)
+	{
+		Socket->HasPendingData(pendingSize);
+	}
+	return pendingSize;
+}
+
+bool FJointSocketTransport::WaitForData(float Seconds)
+{
+	FRWScopeLock usage(SocketUsage, SLT_ReadOnly);
+	if (!bConnected) return true;
+
+	// readable also covers a closed or failed connection, Recv then reports it
+	return Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(Seconds));
+}
+
+FJointPollHandle FJointSocketTransport::BeginWait(bool &bReady)
+{
+	bReady = false;
+	FRWScopeLock usage(SocketUsage, SLT_ReadOnly);
+	if (!bConnected) return JOINT_INVALID_POLL_HANDLE;
+
+	// every socket subsystem with a plain descriptor is built on FSocketBSD, Connect shuts the
+	// socket down before replacing it, so a poll on the old descriptor returns
+	return (FJointPollHandle)static_cast<FSocketBSD*>(Socket)->GetNativeSocket();
+}
+
+
+#if PLATFORM_LINUX
+FJointShmTransport::FJointShmTransport(const FString &Name, bool bFutexWakeup)
+	: Name(Name), bFutexWakeup(bFutexWakeup)
+{
+}
+
+FJointShmTransport::~FJointShmTransport()
+{
+	JointSharedMemory::CloseDoorbell(Doorbell);
+	if (Header)
+	{
+		munmap(Header, MappedSize);
+	}
+	if (FileDescriptor >= 0)
+	{
+		close(FileDescriptor);
+	}
+}
+
+bool FJointShmTransport::Connect(const FString &Address, int32 Port)
+{
+	if (bClosed) return false;
+
+	// reconnecting resets the rings, the bridge reattaches on the new magic
+	if (Header)
+	{
+		ResetRings();
+		return true;
+	}
+
+	// address and port belong to the sockets, the segment is found by name
+	MappedSize = JointSharedMemory::SegmentSize(JOINT_SHM_RING_SIZE);
+
+	FileDescriptor = shm_open(TCHAR_TO_ANSI(*Name), O_CREAT | O_RDWR, 0600);
+	if (FileDescriptor < 0 || ftruncate(FileDescriptor, MappedSize) != 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not create shared memory %s, errno %d"), *Name, errno);
+		return false;
+	}
+
+	void *memory = mmap(nullptr, MappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, FileDescriptor, 0);
+	if (memory == MAP_FAILED)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not map shared memory %s, errno %d"), *Name, errno);
+		return false;
+	}
+
+	// a poller can't wait on a futex and sockets at once, the bridge rings this socket for it instead
+	if (bFutexWakeup && !JointSharedMemory::OpenDoorbell(Doorbell, TCHAR_TO_ANSI(*Name), true))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Could not open the doorbell of shared memory %s, errno %d, the poller checks it every millisecond"), *Name, errno);
+	}
+
+	// a leftover segment from an earlier session is reset, a bridge still attached to it included
+	{
+		FRWScopeLock usage(RingUsage, SLT_Write);
+		Header = (FJointShmHeader*)memory;
+	}
+	ResetRings();
+	return true;
+}
+
+void FJointShmTransport::ResetRings()
+{
+	// our poller leaves its waits once the peer counts as lost, the write lock then waits until it is out of the rings
+	bPeerLost = true;
+	Header->FromBridge.Signal.fetch_add(1);
+	JointSharedMemory::Wake(&Header->FromBridge.Signal);
+	FRWScopeLock usage(RingUsage, SLT_Write);
+
+	// the bridge stops using the rings once it sees the magic cleared and acknowledges by clearing Attached,
+	// the fence orders the magic before our read of Attached against the bridge attaching at the same time
+	Header->Magic = 0;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	const double deadline = FPlatformTime::Seconds() + JOINT_CONNECT_TIMEOUT;
+	while (Header->Attached.load() != 0)
+	{
+		if (FPlatformTime::Seconds() > deadline)
+		{
+			// a bridge that died can't answer, one that is alive but stuck is reset under its feet
+			UE_LOG(LogTemp, Warning, TEXT("Bridge did not detach from shared memory %s, resetting anyway"), *Name);
+			break;
+		}
+
+		// a bridge sleeping on either ring has to wake up to notice
+		Header->ToBridge.Signal.fetch_add(1);
+		Header->FromBridge.Space.fetch_add(1);
+		JointSharedMemory::Wake(&Header->ToBridge.Signal);
+		JointSharedMemory::Wake(&Header->FromBridge.Space);
+		FPlatformProcess::Sleep(0.001f);
+	}
+
+	JointSharedMemory::Initialize(Header, JOINT_SHM_RING_SIZE);
+	PeerGeneration = 0;
+	bPeerLost = false;
+}
+
+void FJointShmTransport::Close()
+{
+	bClosed = true;
+	if (!Header) return;
+
+	Header->Closed.store(1);
+	Header->ToBridge.Signal.fetch_add(1);
+	Header->FromBridge.Signal.fetch_add(1);
+	JointSharedMemory::Wake(&Header->ToBridge.Signal);
+	JointSharedMemory::Wake(&Header->FromBridge.Signal);
+
+	// the mapping stays valid for threads still inside Send or Recv until destruction
+	shm_unlink(TCHAR_TO_ANSI(*Name));
+}
+
+bool FJointShmTransport::CheckPeer() const
+{
+	if (Header->Closed.load() || bPeerLost.load()) return false;
+
+	// a bridge that restarts attaches with a new generation while our rings still hold the old
+	// session, reconnecting resets them and the handshake starts over
+	uint32_t attached = Header->Attached.load();
+	if (attached == 0) return true;
+
+	uint32_t expected = 0;
+	if (PeerGeneration.compare_exchange_strong(expected, attached) || expected == attached) return true;
+
+	if (!bPeerLost.exchange(true))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Bridge reattached to shared memory %s, resetting"), *Name);
+	}
+	return false;
+}
+
+bool FJointShmTransport::WaitForPeer(FJointShmRing *ring, bool bSpace, uint32_t spins)
+{
+	if (!CheckPeer()) return false;
+	if (spins < JOINT_SHM_SPIN_COUNT)
+	{
+		FPlatformProcess::YieldThread();
+		return true;
+	}
+
+	if (!bFutexWakeup)
+	{
+		FPlatformProcess::Sleep(0.0001f);
+		return true;
+	}
+
+	// announce the sleep before rechecking, the peer wakes only announced waiters
+	std::atomic<uint32_t> &word = bSpace ? ring->Space : ring->Signal;
+	std::atomic<uint32_t> &waiting = bSpace ? ring->SpaceWaiting : ring->Waiting;
+	uint32_t signal = word.load();
+	waiting.fetch_or(JOINT_SHM_WAITING_FUTEX);
+	bool ready = bSpace ? JointSharedMemory::Free(Header, ring) > 0 : JointSharedMemory::Pending(ring) > 0;
+	if (!ready && !Header->Closed.load())
+	{
+		JointSharedMemory::Wait(&word, signal, JOINT_SHM_WAIT_US);
+	}
+	waiting.fetch_and(~JOINT_SHM_WAITING_FUTEX);
+	return true;
+}
+
+bool FJointShmTransport::Send(const uint8_t *data, int32 size)
+{
+	if (!Header) return false;
+
+	// the bridge drains the ring, when it is full we wait like a blocked socket
+	uint32_t spins = 0;
+	double blockedSince = 0;
+	while (size > 0)
+	{
+		size_t written = JointSharedMemory::Write(Header, &Header->ToBridge, data, size, bFutexWakeup);
+		if (written > 0)
+		{
+			data += written;
+			size -= written;
+			spins = 0;
+			blockedSince = 0;
+			continue;
+		}
+
+		// a bridge that died never drains again, give up like a socket whose peer vanished
+		double time = FPlatformTime::Seconds();
+		if (blockedSince == 0)
+		{
+			blockedSince = time;
+		}
+		else if (time - blockedSince > JOINT_SHM_SEND_TIMEOUT)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Bridge stopped reading shared memory %s, disconnecting"), *Name);
+			bPeerLost = true;
+			return false;
+		}
+
+		if (!WaitForPeer(&Header->ToBridge, true, spins++)) return false;
+	}
+	return true;
+}
+
+bool FJointShmTransport::Recv(uint8_t *data, int32 size, int32 &bytesRead)
+{
+	bytesRead = 0;
+	FRWScopeLock usage(RingUsage, SLT_ReadOnly);
+	if (!Header) return false;
+
+	for (uint32_t spins = 0; ; spins++)
+	{
+		size_t read = JointSharedMemory::Read(Header, &Header->FromBridge, data, size);
+		if (read > 0)
+		{
+			bytesRead = read;
+			return true;
+		}
+
+		if (!WaitForPeer(&Header->FromBridge, false, spins)) return false;
+	}
+}
+
+uint32 FJointShmTransport::PendingData()
+{
+	FRWScopeLock usage(RingUsage, SLT_ReadOnly);
+	return Header ? JointSharedMemory::Pending(&Header->FromBridge) : 0;
+}
+
+bool FJointShmTransport::WaitForData(float Seconds)
+{
+	FRWScopeLock usage(RingUsage, SLT_ReadOnly);
+	if (!Header) return true;
+
+	FJointShmRing *ring = &Header->FromBridge;
+	if (JointSharedMemory::Pending(ring) > 0 || Header->Closed.load() || bPeerLost) return true;
+	if (Seconds <= 0) return false;
+
+	if (bFutexWakeup)
+	{
+		uint32_t signal = ring->Signal.load();
+		ring->Waiting.fetch_or(JOINT_SHM_WAITING_FUTEX);
+		if (JointSharedMemory::Pending(ring) == 0 && !Header->Closed.load() && !bPeerLost)
+		{
+			JointSharedMemory::Wait(&ring->Signal, signal, (uint32_t)(Seconds * 1000000));
+		}
+		ring->Waiting.fetch_and(~JOINT_SHM_WAITING_FUTEX);
+	}
+	else
+	{
+		FPlatformProcess::Sleep(FMath::Min(Seconds, 0.0001f));
+	}
+
+	return JointSharedMemory::Pending(ring) > 0 || Header->Closed.load();
+}
+
+FJointPollHandle FJointShmTransport::BeginWait(bool &bReady)
+{
+	bReady = false;
+	FRWScopeLock usage(RingUsage, SLT_ReadOnly);
+	if (!Header || Doorbell.Socket < 0) return JOINT_INVALID_POLL_HANDLE;
+
+	// announce before rechecking, like a futex waiter, so a frame published in between rings the doorbell
+	FJointShmRing *ring = &Header->FromBridge;
+	ring->Waiting.fetch_or(JOINT_SHM_WAITING_DOORBELL);
+	bReady = JointSharedMemory::Pending(ring) > 0 || !CheckPeer();
+	return Doorbell.Socket;
+}
+
+void FJointShmTransport::EndWait()
+{
+	FRWScopeLock usage(RingUsage, SLT_ReadOnly);
+	if (!Header || Doorbell.Socket < 0) return;
+
+	Header->FromBridge.Waiting.fetch_and(~JOINT_SHM_WAITING_DOORBELL);
+	JointSharedMemory::DrainDoorbell(Doorbell);
+}
+#endif
+
+
+TUniquePtr<IJointTransport> CreateJointTransport(EJointTransportEnum Type, const FString &SharedMemoryName, bool bFutexWakeup)
+{
+	switch (Type)
+	{
+	case EJointTransportEnum::JTT_Udp:
+		return MakeUnique<FJointSocketTransport>(true);
+	case EJointTransportEnum::JTT_SharedMemory:
+#if PLATFORM_LINUX
+		return MakeUnique<FJointShmTransport>(SharedMemoryName, bFutexWakeup);
+#else
+		UE_LOG(LogTemp, Warning, TEXT("Shared memory transport is only available on Linux, using TCP"));
+		return MakeUnique<FJointSocketTransport>(false);
+#endif
+	default:
+		return MakeUnique<FJointSocketTransport>(false);
+	}
+}
@@ -0,0 +1,174 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Sockets.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/CriticalSection.h"
+#include "JointSharedMemory.h"
+#include "JointTransport.generated.h"
+
+
+/** Largest payload of a single UDP datagram */
+#define JOINT_MAX_DATAGRAM_SIZE 65507
+/** Seconds a connection attempt may take before it counts as failed */
+#define JOINT_CONNECT_TIMEOUT 1.0f
+
+/** Native descriptor FJointPoller waits on, a SOCKET on Windows */
+#if PLATFORM_WINDOWS
+typedef UPTRINT FJointPollHandle;
+#define JOINT_INVALID_POLL_HANDLE (~(UPTRINT)0)
+#else
+typedef int FJointPollHandle;
+#define JOINT_INVALID_POLL_HANDLE (-1)
+#endif
+
+
+UENUM(BlueprintType)
+enum class EJointTransportEnum : uint8
+{
+	JTT_Tcp		UMETA(DisplayName = "TCP (reliable)"),
+	JTT_Udp		UMETA(DisplayName = "UDP (drops stale frames)"),
+	/** Linux only, falls back to TCP elsewhere */
+	JTT_SharedMemory	UMETA(DisplayName = "Shared memory (same host)"),
+};
+
+
+/**
+ * Carries frames between the plugin and the bridge. A failed Send or Recv marks the transport
+ * disconnected, FJointSender then reconnects it from its own thread. Send and Recv may run on
+ * different threads at the same time.
+ */
+class IJointTransport
+{
+public:
+	virtual ~IJointTransport() {}
+
+	/** (Re)connects, blocks for at most JOINT_CONNECT_TIMEOUT. Only called by the sender thread. */
+	virtual bool Connect(const FString &Address, int32 Port) = 0;
+	/** Final shutdown, unblocks Send and Recv on other threads and makes further Connect calls fail */
+	virtual void Close() = 0;
+	virtual bool IsConnected() const = 0;
+	/** Drops the connection, e.g. after a stream lost its frame boundaries. The sender reconnects it. */
+	virtual void Disconnect() = 0;
+
+	/** Datagram transports deliver every frame whole, stream transports may split and merge them */
+	virtual bool IsDatagram() const = 0;
+
+	/** Sends all bytes, a datagram transport sends them as one datagram */
+	virtual bool Send(const uint8_t *data, int32 size) = 0;
+
+	/** Blocks until data arrives and reads as much as fits, a datagram transport reads one datagram */
+	virtual bool Recv(uint8_t *data, int32 size, int32 &bytesRead) = 0;
+
+	/** Bytes that can be read without blocking */
+	virtual uint32 PendingData() = 0;
+
+	/** Waits for at most Seconds until Recv would not block, which includes a lost connection. 0 only checks. */
+	virtual bool WaitForData(float Seconds) = 0;
+
+	/**
+	 * Prepares a wait of the poller thread, which waits on the descriptors of all transports at once.
+	 * Returns a descriptor that turns readable once Recv would not block, or JOINT_INVALID_POLL_HANDLE
+	 * if there is none, the transport is then checked again after a short sleep. Sets bReady if data
+	 * arrived while the wait was announced to the peer. Every call is followed by EndWait.
+	 */
+	virtual FJointPollHandle BeginWait(bool &bReady) = 0;
+	virtual void EndWait() {}
+};
+
+
+/** TCP stream or UDP datagram socket to the bridge */
+class FJointSocketTransport : public IJointTransport
+{
+private:
+	FSocket *Socket;
+	bool bDatagram;
+
+	FThreadSafeBool bConnected;
+	bool bClosed;
+
+	/** Send and Recv hold it shared, replacing the socket holds it exclusively */
+	FRWLock SocketUsage;
+	/** Guards the Socket pointer and bClosed against Close from the game thread */
+	FCriticalSection SocketLock;
+
+	/** Interrupts blocking calls on the current socket and marks the connection lost */
+	void Shutdown();
+
+public:
+	FJointSocketTransport(bool bDatagram);
+	virtual ~FJointSocketTransport();
+
+	//Begin IJointTransport interface
+	virtual bool Connect(const FString &Address, int32 Port) override;
+	virtual void Close() override;
+	virtual bool IsConnected() const override { return bConnected; }
+	virtual void Disconnect() override { Shutdown(); }
+	virtual bool IsDatagram() const override { return bDatagram; }
+	virtual bool Send(const uint8_t *data, int32 size) override;
+	virtual bool Recv(uint8_t *data, int32 size, int32 &bytesRead) override;
+	virtual uint32 PendingData() override;
+	virtual bool WaitForData(float Seconds) override;
+	virtual FJointPollHandle BeginWait(bool &bReady) override;
+	//End IJointTransport interface
+};
+
+
+#if PLATFORM_LINUX
+/**
+ * Two byte rings in a POSIX shared memory segment, for a bridge on the same host. Frames are
+ * the same as on the TCP stream but skip the kernel. The plugin creates and initializes the
+ * segment on Connect, the bridge maps it by name once Magic is set.
+ */
+class FJointShmTransport : public IJointTransport
+{
+private:
+	FString Name;
+	/** Sleep on a futex when a ring is empty instead of polling */
+	bool bFutexWakeup;
+
+	int FileDescriptor = -1;
+	FJointShmHeader *Header = nullptr;
+	size_t MappedSize = 0;
+	bool bClosed = false;
+	/** Rung by the bridge for a poller waiting on several transports, only with bFutexWakeup */
+	JointSharedMemory::FDoorbell Doorbell;
+	/** The receiving side holds it shared while it reads, resetting the rings holds it exclusively */
+	FRWLock RingUsage;
+	/** Set when the bridge stopped draining its ring, was replaced or the stream lost sync, cleared by the next Connect */
+	mutable std::atomic<bool> bPeerLost{ false };
+	/** Attach generation of the bridge we talk to, 0 until it attaches after a Connect */
+	mutable std::atomic<uint32_t> PeerGeneration{ 0 };
+
+	/** False once the bridge closed, stalled or a different bridge attached */
+	bool CheckPeer() const;
+	/** Waits until neither our receiver nor the bridge uses the rings, then reinitializes them */
+	void ResetRings();
+
+	/** Wait for the peer to fill the ring, or with bSpace to drain it, and report whether to keep going */
+	bool WaitForPeer(FJointShmRing *ring, bool bSpace, uint32_t spins);
+
+public:
+	FJointShmTransport(const FString &Name, bool bFutexWakeup);
+	virtual ~FJointShmTransport();
+
+	//Begin IJointTransport interface
+	virtual bool Connect(const FString &Address, int32 Port) override;
+	virtual void Close() override;
+	virtual bool IsConnected() const override { return Header && CheckPeer(); }
+	virtual void Disconnect() override { bPeerLost = true; }
+	virtual bool IsDatagram() const override { return false; }
+	virtual bool Send(const uint8_t *data, int32 size) override;
+	virtual bool Recv(uint8_t *data, int32 size, int32 &bytesRead) override;
+	virtual uint32 PendingData() override;
+	virtual bool WaitForData(float Seconds) override;
+	virtual FJointPollHandle BeginWait(bool &bReady) override;
+	virtual void EndWait() override;
+	//End IJointTransport interface
+};
+#endif
+
+
+TUniquePtr<IJointTransport> CreateJointTransport(EJointTransportEnum Type, const FString &SharedMemoryName, bool bFutexWakeup);
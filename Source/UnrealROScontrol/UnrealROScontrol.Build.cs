@@ -19,6 +19,8 @@ public class UnrealROScontrol : ModuleRules
 
         PrivateIncludePaths.AddRange(
         new string[] {
+            // FSocketBSD, the joint poller waits on the native socket descriptors
+            Path.Combine(EngineDirectory, "Source/Runtime/Sockets/Private"),
             // ... add other private include paths required here ...
         }
     );
@@ -1,4 +1,5 @@
 #include "UnrealROScontrol.h"
+#include "JointPoller.h"
 
 #define LOCTEXT_NAMESPACE "FUnrealROScontrolModule"
 
@@ -11,6 +12,16 @@ void FUnrealROScontrolModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	Poller.Reset();
+}
+
+FJointPoller &FUnrealROScontrolModule::GetPoller()
+{
+	if (!Poller)
+	{
+		Poller = MakeUnique<FJointPoller>();
+	}
+	return *Poller;
 }
 
 #undef LOCTEXT_NAMESPACE
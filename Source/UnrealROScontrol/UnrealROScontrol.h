@@ -3,14 +3,22 @@
 #include <CoreMinimal.h>
 #include <ModuleManager.h>
 
+class FJointPoller;
+
 class FUnrealROScontrolModule : public IModuleInterface
 {
+private:
+	/** Receive thread shared by all joint managers */
+	TUniquePtr<FJointPoller> Poller;
+
 public:
 
 	/** IModuleInterface implementation */
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
 
+	FJointPoller &GetPoller();
+
 	/**
 	* Singleton-like access to this module's interface.  This is just for convenience!
 	* Beware of calling this during the shutdown phase, though.  Your module might have been unloaded already.
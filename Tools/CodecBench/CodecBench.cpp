@@ -0,0 +1,270 @@
+// Throughput and latency benchmark for the wire codec in JointCodec.h.
+//
+// Encodes state frames and decodes command frames of both protocol versions for 1 to 10000 joints,
+// several label lengths and every protocol v2 value encoding, and checks that every frame decodes
+// back to the values it was built from, within the precision of the encoding. With --max-ns-per-joint the run fails if any case with 100 or more joints is slower, so the
+// codec can be gated on plain Linux machines.
+
+#include "JointCodec.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BENCH_CLOBBER(pointer) _ReadWriteBarrier()
+#else
+#define BENCH_CLOBBER(pointer) __asm__ __volatile__("" : : "r"(pointer) : "memory")
+#endif
+
+namespace
+{
+	/** A robot as the codec sees it: IDs, label entries and values in frame order */
+	struct FRobot
+	{
+		std::vector<uint16_t> Ids;
+		std::vector<uint16_t> NetworkIds;
+		std::vector<std::string> Names;
+		std::vector<uint8_t> LabelData;
+		std::vector<int32_t> LabelOffsets;
+		std::vector<int32_t> LabelSizes;
+		FJointLabelEntries Labels;
+		std::vector<double> State;
+		std::vector<double> Command;
+
+		FRobot(int joints, int labelLength)
+		{
+			for (int i = 0; i < joints; i++)
+			{
+				Ids.push_back((uint16_t)i);
+				NetworkIds.push_back(JointCodec::ToNetwork16((uint16_t)i));
+
+				std::string name = "joint_" + std::to_string(i) + "_";
+				name.resize(labelLength > (int)name.size() ? labelLength : name.size(), 'x');
+				Names.push_back(name);
+
+				size_t size = JointCodec::LabelEntrySize(name.size());
+				LabelOffsets.push_back((int32_t)LabelData.size());
+				LabelSizes.push_back((int32_t)size);
+				LabelData.resize(LabelData.size() + size);
+				JointCodec::WriteLabel(LabelData.data() + LabelOffsets.back(), name.data(), name.size());
+
+				Command.push_back((double)rand() / RAND_MAX * 6.28 - 3.14);
+				for (int v = 0; v < 3; v++)
+				{
+					State.push_back((double)rand() / RAND_MAX * 6.28 - 3.14);
+				}
+			}
+
+			Labels.Data = LabelData.data();
+			Labels.Offsets = LabelOffsets.data();
+			Labels.Sizes = LabelSizes.data();
+			Labels.TotalSize = LabelData.size();
+		}
+	};
+
+	/** Decode output, reused across iterations like the plugin's scratch arrays */
+	struct FDecoded
+	{
+		std::vector<uint16_t> Ids;
+		std::vector<double> Values;
+		size_t LabelBytes = 0;
+	};
+
+	bool DecodeIds(const std::vector<uint8_t> &frame, size_t valuesPerJoint, const FJointValueFormat &format, FDecoded &out)
+	{
+		uint32_t length;
+		if (JointCodec::PeekFrame(frame.data(), frame.size(), length) != JointCodec::EFrameStatus::Complete) return false;
+
+		FJointFrameReader reader(frame.data() + 4, length);
+		FJointFrameHeader header;
+		uint16_t count;
+		if (!reader.ReadHeader(header) || !reader.ReadShort(count)) return false;
+
+		out.Ids.resize(count);
+		out.Values.resize(count * valuesPerJoint);
+		const float *scales = valuesPerJoint == 3 ? format.Scales : &format.Scales[JOINT_SCALE_COMMAND];
+		return reader.ReadShorts(out.Ids.data(), count)
+			&& reader.ReadValues(out.Values.data(), count * valuesPerJoint, format.Encoding, scales, valuesPerJoint)
+			&& reader.Pointer == reader.End;
+	}
+
+	/** Exact for doubles, otherwise within float rounding or half a fixed point step */
+	bool Matches(const std::vector<double> &decoded, const std::vector<double> &values, size_t valuesPerJoint, const FJointValueFormat &format)
+	{
+		if (decoded.size() != values.size()) return false;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			double tolerance = 0;
+			if (format.Encoding == EJointValueEncoding::Float) tolerance = 1e-6;
+			if (format.Encoding == EJointValueEncoding::Fixed16) tolerance = (valuesPerJoint == 3 ? format.Scales[i % 3] : format.Scales[JOINT_SCALE_COMMAND]) * 0.5001;
+			if (std::fabs(decoded[i] - values[i]) > tolerance) return false;
+		}
+		return true;
+	}
+
+	bool DecodeLabels(const std::vector<uint8_t> &frame, size_t valuesPerJoint, FDecoded &out)
+	{
+		uint32_t length;
+		if (JointCodec::PeekFrame(frame.data(), frame.size(), length) != JointCodec::EFrameStatus::Complete) return false;
+
+		FJointFrameReader reader(frame.data() + 4, length);
+		FJointFrameHeader header;
+		uint16_t count;
+		if (!reader.ReadHeader(header) || !reader.ReadShort(count)) return false;
+
+		out.Values.resize(count * valuesPerJoint);
+		out.LabelBytes = 0;
+		const char *text;
+		size_t textLength;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!reader.ReadLabel(text, textLength)) return false;
+			out.LabelBytes += textLength;
+			for (size_t v = 0; v < valuesPerJoint; v++)
+			{
+				if (!reader.ReadDouble(out.Values[i * valuesPerJoint + v])) return false;
+			}
+		}
+		return reader.Pointer == reader.End;
+	}
+
+	bool EncodeIdState(const FRobot &robot, const FJointValueFormat &format, std::vector<uint8_t> &frame)
+	{
+		FJointFrameWriter writer(frame.data(), frame.size());
+		return JointCodec::EncodeIdState(writer, 1, 2, FJointFrameEcho(), robot.NetworkIds.data(), robot.State.data(), robot.Ids.size(), format);
+	}
+
+	bool EncodeLabelState(const FRobot &robot, std::vector<uint8_t> &frame)
+	{
+		FJointFrameWriter writer(frame.data(), frame.size());
+		return JointCodec::EncodeLabelState(writer, 1, 2, FJointFrameEcho(), robot.Labels, robot.State.data(), robot.Ids.size());
+	}
+
+	/** Nanoseconds per call, best of several runs to filter out scheduling noise */
+	template <typename Function>
+	double Measure(size_t bytes, Function function)
+	{
+		const int iterations = (int)(50000000 / (bytes + 64)) + 10;
+		double best = 1e30;
+
+		for (int run = 0; run < 5; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++)
+			{
+				if (!function()) return -1;
+			}
+			auto end = std::chrono::steady_clock::now();
+
+			double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+			if (ns < best) best = ns;
+		}
+		return best;
+	}
+
+	struct FResult
+	{
+		bool bOk;
+		double MaxNsPerJoint;
+	};
+
+	FResult Report(const char *variant, int joints, int labelLength, size_t bytes, double ns)
+	{
+		double perJoint = ns / joints;
+		printf("%-22s %7d %6d %10zu %12.1f %10.2f %10.1f\n", variant, joints, labelLength, bytes, ns, bytes / ns * 1000.0, perJoint);
+		return { ns >= 0, joints >= 100 ? perJoint : 0 };
+	}
+}
+
+int main(int argc, char **argv)
+{
+	double maxNsPerJoint = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--max-ns-per-joint") == 0 && i + 1 < argc)
+		{
+			maxNsPerJoint = atof(argv[++i]);
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [--max-ns-per-joint <ns>]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	printf("%-22s %7s %6s %10s %12s %10s %10s\n", "variant", "joints", "label", "bytes", "ns/frame", "MB/s", "ns/joint");
+
+	const int jointCounts[] = { 1, 10, 100, 1000, 10000 };
+	const int labelLengths[] = { 8, 32, 128 };
+	const EJointValueEncoding encodings[] = { EJointValueEncoding::Double, EJointValueEncoding::Float, EJointValueEncoding::Fixed16 };
+	const char *encodingNames[] = { "f64", "f32", "q16" };
+
+	bool ok = true;
+	double slowest = 0;
+	auto check = [&](const FResult &result, const char *variant, int joints)
+	{
+		if (!result.bOk)
+		{
+			fprintf(stderr, "%s failed for %d joints\n", variant, joints);
+			ok = false;
+		}
+		if (result.MaxNsPerJoint > slowest) slowest = result.MaxNsPerJoint;
+	};
+
+	for (int joints : jointCounts)
+	{
+		for (int labelLength : labelLengths)
+		{
+			FRobot robot(joints, labelLength);
+			FDecoded decoded;
+
+			// protocol v2 frames don't carry labels, measure them once per joint count
+			for (size_t e = 0; labelLength == labelLengths[0] && e < sizeof(encodings) / sizeof(encodings[0]); e++)
+			{
+				FJointValueFormat format;
+				format.Encoding = encodings[e];
+				std::string stateVariant = std::string("v2 state encode ") + encodingNames[e];
+				std::string commandVariant = std::string("v2 command decode ") + encodingNames[e];
+
+				std::vector<uint8_t> state(JointCodec::IdStateFrameSize(joints, format.Encoding));
+				bool valid = EncodeIdState(robot, format, state) && DecodeIds(state, 3, format, decoded) && decoded.Ids == robot.Ids && Matches(decoded.Values, robot.State, 3, format);
+				double ns = valid ? Measure(state.size(), [&]() { bool result = EncodeIdState(robot, format, state); BENCH_CLOBBER(state.data()); return result; }) : -1;
+				check(Report(stateVariant.c_str(), joints, 0, state.size(), ns), stateVariant.c_str(), joints);
+
+				std::vector<uint8_t> command(JointCodec::IdCommandFrameSize(joints, format.Encoding));
+				FJointFrameWriter writer(command.data(), command.size());
+				valid = JointCodec::EncodeIdCommand(writer, 3, 4, FJointFrameEcho(), robot.Ids.data(), robot.Command.data(), joints, format)
+					&& DecodeIds(command, 1, format, decoded) && decoded.Ids == robot.Ids && Matches(decoded.Values, robot.Command, 1, format);
+				ns = valid ? Measure(command.size(), [&]() { bool result = DecodeIds(command, 1, format, decoded); BENCH_CLOBBER(decoded.Values.data()); return result; }) : -1;
+				check(Report(commandVariant.c_str(), joints, 0, command.size(), ns), commandVariant.c_str(), joints);
+			}
+
+			std::vector<uint8_t> state(JointCodec::LabelStateFrameSize(robot.Labels, joints));
+			bool valid = EncodeLabelState(robot, state) && DecodeLabels(state, 3, decoded) && decoded.Values == robot.State;
+			double ns = valid ? Measure(state.size(), [&]() { bool result = EncodeLabelState(robot, state); BENCH_CLOBBER(state.data()); return result; }) : -1;
+			check(Report("v1 state encode", joints, labelLength, state.size(), ns), "v1 state encode", joints);
+
+			std::vector<uint8_t> command(JointCodec::LabelCommandFrameSize(robot.Labels, joints));
+			FJointFrameWriter writer(command.data(), command.size());
+			valid = JointCodec::EncodeLabelCommand(writer, 3, 4, FJointFrameEcho(), robot.Labels, robot.Command.data(), joints)
+				&& DecodeLabels(command, 1, decoded) && decoded.Values == robot.Command;
+			ns = valid ? Measure(command.size(), [&]() { bool result = DecodeLabels(command, 1, decoded); BENCH_CLOBBER(decoded.Values.data()); return result; }) : -1;
+			check(Report("v1 command decode", joints, labelLength, command.size(), ns), "v1 command decode", joints);
+		}
+	}
+
+	if (!ok) return 1;
+
+	if (maxNsPerJoint > 0 && slowest > maxNsPerJoint)
+	{
+		fprintf(stderr, "slowest case takes %.1f ns per joint, limit is %.1f\n", slowest, maxNsPerJoint);
+		return 1;
+	}
+	return 0;
+}
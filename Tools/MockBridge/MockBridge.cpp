@@ -0,0 +1,967 @@
+// Stand-in for the ros_control bridge, for soak tests and performance runs without a ROS installation.
+//
+// Listens where AJointManager connects (TCP or UDP on 127.0.0.1:8080 by default, or the shared memory
+// segment on Linux), answers the protocol v2 handshake, sends command frames at a fixed rate and
+// reports state frame throughput, inter-arrival jitter and command to state latency. The latency is
+// measured with the bridge's own clock: every state frame echoes the newest command the plugin had
+// received when it sampled, so the first state echoing a command closes the loop for that command.
+//
+// With --segments the sine goes out as cubic or quintic trajectory segments instead, one per joint and
+// frame covering the next command period, which the plugin interpolates at its physics rate.
+
+#include "JointCodec.h"
+#include "JointSharedMemory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+	volatile std::sig_atomic_t bRun = 1;
+
+	void Interrupt(int)
+	{
+		bRun = 0;
+	}
+
+	/** Microseconds since the Unix epoch, advanced by a monotonic clock like JointTimestamp in the plugin */
+	uint64_t Timestamp()
+	{
+		using namespace std::chrono;
+		static const int64_t offset = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count()
+			- duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+		return (uint64_t)(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count() + offset);
+	}
+
+	struct FOptions
+	{
+		std::string Transport = "tcp";
+		std::string Address = "127.0.0.1";
+		int Port = 8080;
+		std::string SharedMemoryName = "/UnrealROScontrol";
+		double Rate = 100;
+		/** Joints per command frame, 0 commands every joint the plugin announced */
+		int Joints = 0;
+		double Amplitude = 0.5;
+		double Frequency = 0.5;
+		double Duration = 0;
+		double ReportInterval = 1;
+		/** Answers every handshake with doubles, like a bridge that predates the compact encodings */
+		bool bDoublesOnly = false;
+		/** Empty for setpoints, "cubic" or "quintic" for trajectory segments */
+		std::string Segments;
+	};
+
+	/** Min, mean, standard deviation and max over the whole run */
+	struct FRunningStats
+	{
+		uint64_t Count = 0;
+		double Sum = 0;
+		double SumSquares = 0;
+		double Min = 1e30;
+		double Max = 0;
+
+		void Add(double value)
+		{
+			Count++;
+			Sum += value;
+			SumSquares += value * value;
+			Min = std::min(Min, value);
+			Max = std::max(Max, value);
+		}
+
+		double Mean() const { return Count ? Sum / Count : 0; }
+		double Deviation() const { return Count > 1 ? std::sqrt(std::max(0.0, SumSquares / Count - Mean() * Mean())) : 0; }
+	};
+
+	/** Samples of one report interval, kept whole so percentiles are exact */
+	struct FWindow
+	{
+		std::vector<double> Samples;
+
+		double Percentile(double fraction)
+		{
+			if (Samples.empty()) return 0;
+			size_t index = std::min(Samples.size() - 1, (size_t)(fraction * Samples.size()));
+			std::nth_element(Samples.begin(), Samples.begin() + index, Samples.end());
+			return Samples[index];
+		}
+	};
+
+
+	/** Bridge side of the three plugin transports */
+	class ITransport
+	{
+	public:
+		virtual ~ITransport() {}
+		virtual bool IsDatagram() const = 0;
+		/** Accepts or attaches to the plugin, returns true when it just connected */
+		virtual bool Update() = 0;
+		virtual bool IsConnected() const = 0;
+		/** Waits at most timeoutUs for data from the plugin */
+		virtual void Wait(int64_t timeoutUs) = 0;
+		/** Bytes read, 0 when there is nothing, -1 when the plugin went away */
+		virtual long Recv(uint8_t *data, size_t size) = 0;
+		virtual bool Send(const uint8_t *data, size_t size) = 0;
+	};
+
+	class FTcpTransport : public ITransport
+	{
+	public:
+		int Listener = -1;
+		int Client = -1;
+
+		bool Open(const FOptions &options)
+		{
+			Listener = socket(AF_INET, SOCK_STREAM, 0);
+			int reuse = 1;
+			setsockopt(Listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_port = htons((uint16_t)options.Port);
+			if (inet_pton(AF_INET, options.Address.c_str(), &address.sin_addr) != 1
+				|| bind(Listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(Listener, 1) != 0)
+			{
+				perror("tcp listen");
+				return false;
+			}
+			return true;
+		}
+
+		~FTcpTransport()
+		{
+			if (Client >= 0) close(Client);
+			if (Listener >= 0) close(Listener);
+		}
+
+		bool IsDatagram() const override { return false; }
+		bool IsConnected() const override { return Client >= 0; }
+
+		bool Update() override
+		{
+			if (Client >= 0) return false;
+
+			pollfd descriptor = { Listener, POLLIN, 0 };
+			if (poll(&descriptor, 1, 0) <= 0) return false;
+
+			Client = accept(Listener, nullptr, nullptr);
+			if (Client < 0) return false;
+			int noDelay = 1;
+			setsockopt(Client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+			return true;
+		}
+
+		void Wait(int64_t timeoutUs) override
+		{
+			pollfd descriptor = { Client >= 0 ? Client : Listener, POLLIN, 0 };
+			poll(&descriptor, 1, (int)std::max<int64_t>(0, timeoutUs / 1000));
+		}
+
+		long Recv(uint8_t *data, size_t size) override
+		{
+			if (Client < 0) return -1;
+			long received = recv(Client, data, size, MSG_DONTWAIT);
+			if (received > 0) return received;
+			if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+
+			close(Client);
+			Client = -1;
+			return -1;
+		}
+
+		bool Send(const uint8_t *data, size_t size) override
+		{
+			while (size > 0 && Client >= 0)
+			{
+				long sent = send(Client, data, size, MSG_NOSIGNAL);
+				if (sent < 0)
+				{
+					if (errno == EINTR) continue;
+					return false;
+				}
+				data += sent;
+				size -= sent;
+			}
+			return size == 0;
+		}
+	};
+
+	class FUdpTransport : public ITransport
+	{
+	public:
+		int Socket = -1;
+		sockaddr_in Peer = {};
+		bool bHasPeer = false;
+		bool bPeerChanged = false;
+
+		bool Open(const FOptions &options)
+		{
+			Socket = socket(AF_INET, SOCK_DGRAM, 0);
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_port = htons((uint16_t)options.Port);
+			if (inet_pton(AF_INET, options.Address.c_str(), &address.sin_addr) != 1 || bind(Socket, (sockaddr*)&address, sizeof(address)) != 0)
+			{
+				perror("udp bind");
+				return false;
+			}
+			return true;
+		}
+
+		~FUdpTransport()
+		{
+			if (Socket >= 0) close(Socket);
+		}
+
+		bool IsDatagram() const override { return true; }
+		bool IsConnected() const override { return bHasPeer; }
+
+		bool Update() override
+		{
+			bool changed = bPeerChanged;
+			bPeerChanged = false;
+			return changed;
+		}
+
+		void Wait(int64_t timeoutUs) override
+		{
+			pollfd descriptor = { Socket, POLLIN, 0 };
+			poll(&descriptor, 1, (int)std::max<int64_t>(0, timeoutUs / 1000));
+		}
+
+		long Recv(uint8_t *data, size_t size) override
+		{
+			sockaddr_in from = {};
+			socklen_t fromSize = sizeof(from);
+			long received = recvfrom(Socket, data, size, MSG_DONTWAIT, (sockaddr*)&from, &fromSize);
+			if (received <= 0) return 0;
+
+			// the plugin binds a new port when it reconnects, follow it
+			if (!bHasPeer || from.sin_port != Peer.sin_port || from.sin_addr.s_addr != Peer.sin_addr.s_addr)
+			{
+				Peer = from;
+				bHasPeer = true;
+				bPeerChanged = true;
+			}
+			return received;
+		}
+
+		bool Send(const uint8_t *data, size_t size) override
+		{
+			if (!bHasPeer || size > JOINT_MAX_DATAGRAM) return false;
+			return sendto(Socket, data, size, 0, (const sockaddr*)&Peer, sizeof(Peer)) == (long)size;
+		}
+
+		static const size_t JOINT_MAX_DATAGRAM = 65507;
+	};
+
+	/** Attaches to the segment the plugin creates, see FJointShmTransport */
+	class FShmTransport : public ITransport
+	{
+	public:
+		std::string Name;
+		FJointShmHeader *Header = nullptr;
+		size_t MappedSize = 0;
+		bool bAttached = false;
+		/** Our attach generation, cleared from Attached again to let the plugin reset the rings */
+		uint32_t Generation = 0;
+		/** Wakes the plugin's poller, which waits on sockets and can't sleep on the futex */
+		JointSharedMemory::FDoorbell Doorbell;
+
+		~FShmTransport()
+		{
+			if (!Header) return;
+
+			// tell the plugin right away instead of letting it find out from a full ring
+			if (bAttached)
+			{
+				Header->Closed.store(1);
+				Header->FromBridge.Signal.fetch_add(1);
+				Header->ToBridge.Space.fetch_add(1);
+				JointSharedMemory::Wake(&Header->FromBridge.Signal);
+				JointSharedMemory::Wake(&Header->ToBridge.Space);
+				JointSharedMemory::RingDoorbell(Doorbell, &Header->FromBridge);
+			}
+			Detach();
+			JointSharedMemory::CloseDoorbell(Doorbell);
+			munmap(Header, MappedSize);
+		}
+
+		/** Stops using the rings and tells the plugin, which waits for that before it resets them */
+		void Detach()
+		{
+			bAttached = false;
+			uint32_t expected = Generation;
+			Header->Attached.compare_exchange_strong(expected, 0);
+		}
+
+		bool IsValid() const
+		{
+			return Header->Magic == JOINT_SHM_MAGIC && Header->Version == JOINT_SHM_VERSION
+				&& Header->RingSize == JOINT_SHM_RING_SIZE && !Header->Closed.load();
+		}
+
+		bool IsDatagram() const override { return false; }
+		bool IsConnected() const override { return bAttached; }
+
+		bool Update() override
+		{
+			if (!Header)
+			{
+				int descriptor = shm_open(Name.c_str(), O_RDWR, 0600);
+				if (descriptor < 0) return false;
+
+				MappedSize = JointSharedMemory::SegmentSize(JOINT_SHM_RING_SIZE);
+				void *memory = mmap(nullptr, MappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+				close(descriptor);
+				if (memory == MAP_FAILED) return false;
+				Header = (FJointShmHeader*)memory;
+				JointSharedMemory::OpenDoorbell(Doorbell, Name.c_str(), false);
+			}
+
+			// the plugin clears the magic and waits for us to detach before it reinitializes the rings
+			if (!IsValid())
+			{
+				Detach();
+				return false;
+			}
+			if (bAttached && Header->Attached.load() == Generation) return false;
+
+			// first attach, or the plugin reset the rings under us, either way a new session
+			do
+			{
+				Generation = Header->AttachCount.fetch_add(1) + 1;
+			} while (Generation == 0);
+			Header->Attached.store(Generation);
+
+			// the plugin may have cleared the magic before it could see us attached, back off so it can go on
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!IsValid())
+			{
+				Detach();
+				return false;
+			}
+			bAttached = true;
+			return true;
+		}
+
+		void Wait(int64_t timeoutUs) override
+		{
+			if (!bAttached || JointSharedMemory::Pending(&Header->ToBridge) > 0)
+			{
+				if (!bAttached) std::this_thread::sleep_for(std::chrono::microseconds(std::min<int64_t>(timeoutUs, 10000)));
+				return;
+			}
+
+			FJointShmRing *ring = &Header->ToBridge;
+			uint32_t signal = ring->Signal.load();
+			ring->Waiting.store(JOINT_SHM_WAITING_FUTEX);
+			if (JointSharedMemory::Pending(ring) == 0 && !Header->Closed.load())
+			{
+				JointSharedMemory::Wait(&ring->Signal, signal, (uint32_t)std::max<int64_t>(0, timeoutUs));
+			}
+			ring->Waiting.store(0);
+		}
+
+		long Recv(uint8_t *data, size_t size) override
+		{
+			if (!bAttached || Header->Closed.load() || Header->Magic != JOINT_SHM_MAGIC || Header->Attached.load() != Generation)
+			{
+				Detach();
+				return -1;
+			}
+			return (long)JointSharedMemory::Read(Header, &Header->ToBridge, data, size);
+		}
+
+		bool Send(const uint8_t *data, size_t size) override
+		{
+			FJointShmRing *ring = &Header->FromBridge;
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+			while (size > 0)
+			{
+				if (!bAttached || Header->Closed.load()) return false;
+				if (Header->Magic != JOINT_SHM_MAGIC)
+				{
+					Detach();
+					return false;
+				}
+
+				size_t written = JointSharedMemory::Write(Header, ring, data, size, true);
+				if (written > 0)
+				{
+					JointSharedMemory::RingDoorbell(Doorbell, ring);
+					data += written;
+					size -= written;
+					deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+					continue;
+				}
+
+				// the plugin is behind, commands must not be dropped halfway through a frame,
+				// but a plugin that stopped reading for good is treated as gone
+				if (std::chrono::steady_clock::now() > deadline)
+				{
+					fprintf(stderr, "Plugin stopped reading shared memory, detaching\n");
+					Detach();
+					return false;
+				}
+
+				uint32_t space = ring->Space.load();
+				ring->SpaceWaiting.store(1);
+				if (JointSharedMemory::Free(Header, ring) == 0 && !Header->Closed.load())
+				{
+					JointSharedMemory::Wait(&ring->Space, space, 100000);
+				}
+				ring->SpaceWaiting.store(0);
+			}
+			return true;
+		}
+	};
+
+
+	class FMockBridge
+	{
+	public:
+		FMockBridge(const FOptions &options, ITransport *transport)
+			: Options(options), Transport(transport)
+		{
+			Buffer.resize(1 << 16);
+		}
+
+		int Run()
+		{
+			using Clock = std::chrono::steady_clock;
+			const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / Options.Rate));
+			const auto start = Clock::now();
+			auto nextCommand = start;
+			auto nextReport = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(Options.ReportInterval));
+			LastReport = start;
+
+			printf("mock bridge on %s, %s at %.0f Hz\n", Options.Transport.c_str(), Options.Segments.empty() ? "commands" : "segments", Options.Rate);
+
+			while (bRun)
+			{
+				if (Transport->Update())
+				{
+					ResetSession();
+					printf("plugin connected\n");
+				}
+
+				auto now = Clock::now();
+				if (Options.Duration > 0 && now - start >= std::chrono::duration<double>(Options.Duration)) break;
+
+				if (now >= nextCommand)
+				{
+					if (Transport->IsConnected()) SendCommand();
+
+					nextCommand += period;
+					if (now - nextCommand > period * 10)
+					{
+						// far behind after a stall, skip the missed ticks instead of bursting them out
+						MissedTicks += (now - nextCommand) / period;
+						nextCommand = now + period;
+					}
+				}
+
+				if (now >= nextReport)
+				{
+					Report(now);
+					nextReport += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(Options.ReportInterval));
+				}
+
+				auto wakeup = std::min(nextCommand, nextReport);
+				Transport->Wait(std::chrono::duration_cast<std::chrono::microseconds>(wakeup - Clock::now()).count());
+				if (Transport->IsConnected()) Receive();
+			}
+
+			Summary();
+			return StateArrival.Count > 0 ? 0 : 1;
+		}
+
+	private:
+		const FOptions &Options;
+		ITransport *Transport;
+
+		std::vector<uint8_t> Buffer;
+		size_t Used = 0;
+
+		uint16_t Version = JOINT_PROTOCOL_LABELS;
+		FJointValueFormat Format;
+		std::vector<uint16_t> Ids;
+		std::vector<std::string> Names;
+
+		std::vector<uint16_t> CommandIds;
+		std::vector<uint8_t> LabelData;
+		std::vector<int32_t> LabelOffsets;
+		std::vector<int32_t> LabelSizes;
+		FJointLabelEntries Labels = {};
+		std::vector<double> Values;
+		std::vector<FJointTrajectorySegment> Segments;
+		/** Bridge time the next segment starts at, segments join without gaps */
+		uint64_t NextSegmentStart = 0;
+		std::vector<uint8_t> Frame;
+		bool bCommandsDirty = true;
+
+		uint32_t Sequence = 0;
+		FJointFrameEcho Echo;
+		/** Send time of every command still waiting for its first state echo */
+		std::map<uint32_t, uint64_t> PendingCommands;
+		uint32_t LastEchoed = 0;
+		bool bHasEcho = false;
+
+		uint64_t LastStateTime = 0;
+		uint32_t LastStateSequence = 0;
+		bool bHasState = false;
+
+		FRunningStats StateArrival;
+		FRunningStats Latency;
+		FWindow StateWindow;
+		FWindow LatencyWindow;
+		uint64_t StateFrames = 0;
+		uint64_t StateBytes = 0;
+		uint64_t DeltaFrames = 0;
+		uint64_t CommandFrames = 0;
+		uint64_t CommandBytes = 0;
+		uint64_t LostStates = 0;
+		uint64_t MissedTicks = 0;
+		uint64_t WindowStateFrames = 0;
+		uint64_t WindowStateBytes = 0;
+		uint64_t WindowCommandFrames = 0;
+		std::chrono::steady_clock::time_point LastReport;
+
+		void ResetSession()
+		{
+			Used = 0;
+			Version = JOINT_PROTOCOL_LABELS;
+			Format = FJointValueFormat();
+			Ids.clear();
+			Names.clear();
+			bCommandsDirty = true;
+			Echo = FJointFrameEcho();
+			PendingCommands.clear();
+			NextSegmentStart = 0;
+			bHasEcho = false;
+			bHasState = false;
+		}
+
+		void Receive()
+		{
+			while (true)
+			{
+				if (Used == Buffer.size()) Buffer.resize(Buffer.size() * 2);
+
+				long received = Transport->Recv(Buffer.data() + Used, Buffer.size() - Used);
+				if (received < 0)
+				{
+					printf("plugin disconnected\n");
+					ResetSession();
+					return;
+				}
+				if (received == 0) return;
+				Used += received;
+
+				size_t offset = 0;
+				uint32_t length;
+				while (true)
+				{
+					JointCodec::EFrameStatus status = JointCodec::PeekFrame(Buffer.data() + offset, Used - offset, length);
+					if (status == JointCodec::EFrameStatus::Invalid)
+					{
+						fprintf(stderr, "invalid frame, dropping the received data\n");
+						offset = Used;
+						break;
+					}
+					if (status == JointCodec::EFrameStatus::Incomplete)
+					{
+						if (Buffer.size() < length + 4) Buffer.resize(length + 4);
+						break;
+					}
+
+					DecodeFrame(Buffer.data() + offset + 4, length, length + 4);
+					offset += length + 4;
+				}
+
+				// a datagram is one frame, whatever is left of it is garbage
+				if (Transport->IsDatagram()) offset = Used;
+				memmove(Buffer.data(), Buffer.data() + offset, Used - offset);
+				Used -= offset;
+			}
+		}
+
+		void DecodeFrame(const uint8_t *frame, uint32_t length, size_t frameSize)
+		{
+			FJointFrameReader reader(frame, length);
+			FJointFrameHeader header;
+			if (!reader.ReadHeader(header)) return;
+
+			if ((EJointFrameType)header.Type == EJointFrameType::Handshake)
+			{
+				uint16_t version, count;
+				if (!reader.ReadShort(version) || !reader.ReadShort(count)) return;
+
+				std::vector<uint16_t> ids(count);
+				std::vector<std::string> names(count);
+				for (size_t i = 0; i < count; i++)
+				{
+					const char *text;
+					size_t textLength;
+					if (!reader.ReadShort(ids[i]) || !reader.ReadLabel(text, textLength)) return;
+					names[i].assign(text, textLength);
+				}
+
+				// the requested encoding follows the entries, a plugin without it only speaks doubles
+				FJointValueFormat format;
+				uint8_t encoding;
+				if (reader.ReadByte(encoding) && JointCodec::IsValidEncoding(encoding) && !Options.bDoublesOnly)
+				{
+					format.Encoding = (EJointValueEncoding)encoding;
+					for (size_t i = 0; i < JOINT_SCALE_COUNT; i++)
+					{
+						if (!reader.ReadFloat(format.Scales[i]) || !(format.Scales[i] > 0)) format.Encoding = EJointValueEncoding::Double;
+					}
+				}
+
+				Version = version == JOINT_PROTOCOL_IDS ? JOINT_PROTOCOL_IDS : JOINT_PROTOCOL_LABELS;
+				Format = format;
+				Ids.swap(ids);
+				Names.swap(names);
+				bCommandsDirty = true;
+				printf("handshake, protocol v%d, %zu joints, value encoding %d\n", (int)Version, Ids.size(), (int)Format.Encoding);
+
+				// the reply carries the version and the encoding the bridge speaks
+				uint8_t reply[JOINT_FRAME_HEADER_SIZE + 3];
+				uint8_t *pointer = JointCodec::WriteFrameHeader(reply, sizeof(reply), EJointFrameType::Handshake, Sequence++, Timestamp(), Echo);
+				pointer = JointCodec::WriteShort(pointer, Version);
+				*pointer = (uint8_t)Format.Encoding;
+				Transport->Send(reply, sizeof(reply));
+				return;
+			}
+
+			// delta frames only list the joints that moved, they still pace the state stream
+			const bool bDelta = (EJointFrameType)header.Type == EJointFrameType::StateDelta;
+			if ((EJointFrameType)header.Type != EJointFrameType::State && !bDelta) return;
+
+			const uint64_t now = Timestamp();
+			if (bHasState)
+			{
+				if (!IsNewer(header.Sequence, LastStateSequence)) return;
+				LostStates += header.Sequence - LastStateSequence - 1;
+
+				double interval = (double)(now - LastStateTime);
+				StateArrival.Add(interval);
+				StateWindow.Samples.push_back(interval);
+			}
+			LastStateTime = now;
+			LastStateSequence = header.Sequence;
+			bHasState = true;
+
+			StateFrames++;
+			StateBytes += frameSize;
+			if (bDelta) DeltaFrames++;
+			WindowStateFrames++;
+			WindowStateBytes += frameSize;
+
+			// the next command tells the plugin which state it answers
+			Echo.Sequence = header.Sequence;
+			Echo.Timestamp = header.Timestamp;
+
+			if (header.Echo.Timestamp != 0 && (!bHasEcho || IsNewer(header.Echo.Sequence, LastEchoed)))
+			{
+				LastEchoed = header.Echo.Sequence;
+				bHasEcho = true;
+
+				auto command = PendingCommands.find(header.Echo.Sequence);
+				if (command != PendingCommands.end())
+				{
+					double latency = (double)(now - command->second);
+					Latency.Add(latency);
+					LatencyWindow.Samples.push_back(latency);
+				}
+				// older commands were overtaken, the plugin never sampled right after them
+				PendingCommands.erase(PendingCommands.begin(), PendingCommands.upper_bound(header.Echo.Sequence));
+			}
+
+			// protocol v1 has no handshake, the joints are learned from the first state frame
+			if (Version == JOINT_PROTOCOL_LABELS && Names.empty() && !bDelta)
+			{
+				uint16_t count;
+				if (!reader.ReadShort(count)) return;
+				for (size_t i = 0; i < count; i++)
+				{
+					const char *text;
+					size_t textLength;
+					double values[3];
+					if (!reader.ReadLabel(text, textLength) || !reader.ReadDouble(values[0]) || !reader.ReadDouble(values[1]) || !reader.ReadDouble(values[2])) break;
+					Names.emplace_back(text, textLength);
+				}
+				bCommandsDirty = true;
+			}
+		}
+
+		static bool IsNewer(uint32_t sequence, uint32_t last)
+		{
+			return (int32_t)(sequence - last) > 0;
+		}
+
+		/** Commands cover the announced joints first, extra joints get IDs and labels the plugin ignores */
+		void PrepareCommands()
+		{
+			size_t known = Version == JOINT_PROTOCOL_IDS ? Ids.size() : Names.size();
+			size_t count = Options.Joints > 0 ? (size_t)Options.Joints : known;
+
+			uint16_t nextId = 0;
+			for (uint16_t id : Ids) nextId = std::max<uint16_t>(nextId, id + 1);
+
+			CommandIds.resize(count);
+			LabelOffsets.resize(count);
+			LabelSizes.resize(count);
+			LabelData.clear();
+			for (size_t i = 0; i < count; i++)
+			{
+				std::string name = i < Names.size() ? Names[i] : "mock_joint_" + std::to_string(i);
+				CommandIds[i] = i < Ids.size() ? Ids[i] : nextId++;
+
+				LabelSizes[i] = (int32_t)JointCodec::LabelEntrySize(name.size());
+				LabelOffsets[i] = (int32_t)LabelData.size();
+				LabelData.resize(LabelData.size() + LabelSizes[i]);
+				JointCodec::WriteLabel(LabelData.data() + LabelOffsets[i], name.data(), name.size());
+			}
+
+			Labels.Data = LabelData.data();
+			Labels.Offsets = LabelOffsets.data();
+			Labels.Sizes = LabelSizes.data();
+			Labels.TotalSize = LabelData.size();
+
+			Values.resize(count);
+			Segments.resize(count);
+			Frame.resize(Version == JOINT_PROTOCOL_IDS
+				? std::max(JointCodec::IdCommandFrameSize(count, Format.Encoding), JointCodec::TrajectoryFrameSize(count))
+				: JointCodec::LabelCommandFrameSize(Labels, count));
+			bCommandsDirty = false;
+
+			if (!Options.Segments.empty() && Version != JOINT_PROTOCOL_IDS)
+			{
+				fprintf(stderr, "trajectory segments need protocol v2, sending setpoints\n");
+			}
+
+			if (Transport->IsDatagram() && Frame.size() > FUdpTransport::JOINT_MAX_DATAGRAM)
+			{
+				fprintf(stderr, "%zu joints do not fit a datagram, commands are not sent\n", count);
+			}
+		}
+
+		void SendCommand()
+		{
+			if (bCommandsDirty) PrepareCommands();
+			// protocol v1 waits for the first state frame to learn the labels
+			if (Values.empty()) return;
+
+			// every joint follows its own phase of a sine
+			const uint64_t now = Timestamp();
+			const double time = now / 1000000.0;
+			for (size_t i = 0; i < Values.size(); i++)
+			{
+				Values[i] = Options.Amplitude * std::sin(2 * M_PI * Options.Frequency * time + i * 0.1);
+			}
+
+			FJointFrameWriter writer(Frame.data(), Frame.size());
+			const uint32_t sequence = Sequence++;
+			bool encoded;
+			if (!Options.Segments.empty() && Version == JOINT_PROTOCOL_IDS)
+			{
+				PrepareSegments(now);
+				encoded = JointCodec::EncodeTrajectory(writer, sequence, now, Echo, Segments.data(), Segments.size());
+			}
+			else
+			{
+				encoded = Version == JOINT_PROTOCOL_IDS
+					? JointCodec::EncodeIdCommand(writer, sequence, now, Echo, CommandIds.data(), Values.data(), Values.size(), Format)
+					: JointCodec::EncodeLabelCommand(writer, sequence, now, Echo, Labels, Values.data(), Values.size());
+			}
+			if (!encoded || !Transport->Send(Frame.data(), writer.Size())) return;
+
+			PendingCommands[sequence] = now;
+			// a plugin that stopped sampling must not make the map grow without bound
+			if (PendingCommands.size() > 10000) PendingCommands.erase(PendingCommands.begin());
+
+			CommandFrames++;
+			CommandBytes += writer.Size();
+			WindowCommandFrames++;
+		}
+
+		/** The sine over the next command period, starting one period ahead so the plugin has it before it is due */
+		void PrepareSegments(uint64_t now)
+		{
+			const uint32_t duration = (uint32_t)(1000000.0 / Options.Rate);
+			// after a stall the plugin has run out, start over instead of sending segments from the past
+			if (NextSegmentStart < now) NextSegmentStart = now + duration;
+
+			const double omega = 2 * M_PI * Options.Frequency;
+			const double start = NextSegmentStart / 1000000.0;
+			const double end = start + duration / 1000000.0;
+			const double a = Options.Amplitude;
+			for (size_t i = 0; i < Segments.size(); i++)
+			{
+				FJointTrajectorySegment &segment = Segments[i];
+				segment.Id = CommandIds[i];
+				segment.Start = NextSegmentStart;
+				segment.Duration = duration;
+
+				const double phase0 = omega * start + i * 0.1;
+				const double phase1 = omega * end + i * 0.1;
+				if (Options.Segments == "quintic")
+				{
+					JointCodec::MakeQuinticSegment(segment.Coefficients,
+						a * std::sin(phase0), a * omega * std::cos(phase0), -a * omega * omega * std::sin(phase0),
+						a * std::sin(phase1), a * omega * std::cos(phase1), -a * omega * omega * std::sin(phase1), duration / 1000000.0);
+				}
+				else
+				{
+					JointCodec::MakeCubicSegment(segment.Coefficients,
+						a * std::sin(phase0), a * omega * std::cos(phase0),
+						a * std::sin(phase1), a * omega * std::cos(phase1), duration / 1000000.0);
+				}
+			}
+			NextSegmentStart += duration;
+		}
+
+		void Report(std::chrono::steady_clock::time_point now)
+		{
+			double elapsed = std::chrono::duration<double>(now - LastReport).count();
+			LastReport = now;
+
+			printf("state %7.1f/s %8.3f MB/s  interval p50 %8.1f p99 %8.1f max %8.1f us  command %7.1f/s  latency p50 %8.1f p99 %8.1f us\n",
+				WindowStateFrames / elapsed, WindowStateBytes / elapsed / 1e6,
+				StateWindow.Percentile(0.5), StateWindow.Percentile(0.99), StateWindow.Percentile(1.0),
+				WindowCommandFrames / elapsed,
+				LatencyWindow.Percentile(0.5), LatencyWindow.Percentile(0.99));
+			fflush(stdout);
+
+			StateWindow.Samples.clear();
+			LatencyWindow.Samples.clear();
+			WindowStateFrames = 0;
+			WindowStateBytes = 0;
+			WindowCommandFrames = 0;
+		}
+
+		void Summary()
+		{
+			printf("\nstate frames    %llu (%llu bytes, %llu deltas, %llu lost)\n", (unsigned long long)StateFrames, (unsigned long long)StateBytes,
+				(unsigned long long)DeltaFrames, (unsigned long long)LostStates);
+			printf("command frames  %llu (%llu bytes, %llu ticks missed)\n", (unsigned long long)CommandFrames, (unsigned long long)CommandBytes, (unsigned long long)MissedTicks);
+			printf("state interval  mean %.1f us, jitter (stddev) %.1f us, min %.1f us, max %.1f us\n",
+				StateArrival.Mean(), StateArrival.Deviation(), StateArrival.Count ? StateArrival.Min : 0, StateArrival.Max);
+			printf("command->state  mean %.1f us, stddev %.1f us, min %.1f us, max %.1f us, %llu samples\n",
+				Latency.Mean(), Latency.Deviation(), Latency.Count ? Latency.Min : 0, Latency.Max, (unsigned long long)Latency.Count);
+		}
+	};
+
+	void Usage(const char *program)
+	{
+		fprintf(stderr,
+			"usage: %s [options]\n"
+			"  --transport tcp|udp|shm   transport selected on the JointManager (tcp)\n"
+			"  --address <ip>            address to listen on (127.0.0.1)\n"
+			"  --port <port>             port to listen on (8080)\n"
+			"  --shm-name <name>         shared memory segment name (/UnrealROScontrol)\n"
+			"  --rate <hz>               command frames per second, 50 to 1000, from 5 with segments (100)\n"
+			"  --joints <n>              joints per command frame, 0 for the announced joints (0)\n"
+			"  --amplitude <rad>         amplitude of the commanded sine (0.5)\n"
+			"  --frequency <hz>          frequency of the commanded sine (0.5)\n"
+			"  --duration <s>            stop after this long, 0 runs until interrupted (0)\n"
+			"  --report <s>              seconds between report lines (1)\n"
+			"  --segments cubic|quintic  send trajectory segments instead of setpoints, needs protocol v2\n"
+			"  --doubles-only            answer the handshake without a compact value encoding\n",
+			program);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	FOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--doubles-only")
+		{
+			options.bDoublesOnly = true;
+			continue;
+		}
+
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			Usage(argv[0]);
+			return 2;
+		}
+		i++;
+
+		if (option == "--transport") options.Transport = value;
+		else if (option == "--address") options.Address = value;
+		else if (option == "--port") options.Port = atoi(value);
+		else if (option == "--shm-name") options.SharedMemoryName = value;
+		else if (option == "--rate") options.Rate = atof(value);
+		else if (option == "--joints") options.Joints = atoi(value);
+		else if (option == "--amplitude") options.Amplitude = atof(value);
+		else if (option == "--frequency") options.Frequency = atof(value);
+		else if (option == "--duration") options.Duration = atof(value);
+		else if (option == "--report") options.ReportInterval = atof(value);
+		else if (option == "--segments") options.Segments = value;
+		else
+		{
+			Usage(argv[0]);
+			return 2;
+		}
+	}
+
+	// segments cover a whole period, so their frames can come much less often than setpoints
+	const double minimumRate = options.Segments.empty() ? 50 : 5;
+	if ((!options.Segments.empty() && options.Segments != "cubic" && options.Segments != "quintic")
+		|| options.Rate < minimumRate || options.Rate > 1000 || options.Joints < 0 || options.Joints > 65535 || options.ReportInterval <= 0)
+	{
+		Usage(argv[0]);
+		return 2;
+	}
+
+	signal(SIGINT, Interrupt);
+	signal(SIGTERM, Interrupt);
+
+	FTcpTransport tcp;
+	FUdpTransport udp;
+	FShmTransport shm;
+	ITransport *transport = nullptr;
+	if (options.Transport == "tcp" && tcp.Open(options)) transport = &tcp;
+	else if (options.Transport == "udp" && udp.Open(options)) transport = &udp;
+	else if (options.Transport == "shm")
+	{
+		shm.Name = options.SharedMemoryName;
+		transport = &shm;
+	}
+
+	if (!transport)
+	{
+		if (options.Transport != "tcp" && options.Transport != "udp" && options.Transport != "shm") Usage(argv[0]);
+		return 2;
+	}
+
+	FMockBridge bridge(options, transport);
+	return bridge.Run();
+}